@@ -0,0 +1,47 @@
+#pragma once
+#include "connection_pool.h"
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// The book columns that feed the per-user aggregates.
+struct BookFacts {
+    std::string status;
+    std::string genre;
+    int rating = 0;        // 0 = unrated
+    int pagesRead = 0;
+    int totalPages = 0;
+};
+
+// A user's library aggregates, as served by /api/analytics.
+struct LibraryStats {
+    int64_t totalBooks = 0;
+    int64_t ratedBooks = 0;
+    int64_t ratingSum = 0;
+    int64_t pagesRead = 0;
+    int64_t totalPages = 0;
+    std::vector<std::pair<std::string, int64_t>> statusCounts;
+    std::vector<std::pair<std::string, int64_t>> genres;    // most common first
+};
+
+// Per-user aggregates over books (user_book_stats, user_status_counts,
+// user_genre_counts), maintained by applying each book write as a delta
+// inside the write's own transaction, so reads never scan books.
+namespace analytics {
+
+// Moves the aggregates from `before` to `after`; either may be null for
+// an insert or delete.
+void applyChange(Connection& conn, int userId, const BookFacts* before, const BookFacts* after);
+
+// Adds many new books at once, touching each counter once.
+void applyInserts(Connection& conn, int userId, const std::vector<BookFacts>& added);
+
+LibraryStats load(Connection& conn, int userId);
+
+// Number of users whose stored aggregates differ from a recount of books.
+int verify(SQLite::Database& db);
+// Recomputes every user's aggregates from books. Run inside a transaction.
+void rebuild(SQLite::Database& db);
+
+} // namespace analytics
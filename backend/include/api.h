@@ -1,7 +1,98 @@
 #pragma once
-#include <nlohmann/json.hpp>
+#include "search_cache.h"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
+typedef void CURL;
+typedef void CURLM;
+
+// Too many searches are already waiting on upstream; retry later.
+struct SearchOverloaded : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// Upstream did not answer before the caller's deadline.
+struct SearchTimeout : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// Google Books volumes search behind a cache. All upstream I/O runs on one
+// event thread driving a curl multi handle, so a slow upstream costs
+// sockets rather than server threads. Identical concurrent searches share
+// one upstream fetch, and callers wait only up to a deadline.
 class GoogleBooksAPI {
 public:
-    nlohmann::json search(const std::string& query);
+    struct Options {
+        // Can point at a local stand-in server for offline testing.
+        std::string baseUrl = "https://www.googleapis.com/books/v1/volumes";
+        size_t cacheEntries = 4096;
+        std::chrono::seconds cacheTtl = std::chrono::minutes(10);
+        // Callers allowed to wait on upstream at once; the rest are
+        // rejected with SearchOverloaded instead of queueing.
+        int maxWaiting = 8;
+        std::chrono::milliseconds deadline = std::chrono::seconds(3);
+    };
+
+    GoogleBooksAPI();
+    explicit GoogleBooksAPI(Options options);
+    ~GoogleBooksAPI();
+    GoogleBooksAPI(const GoogleBooksAPI&) = delete;
+    GoogleBooksAPI& operator=(const GoogleBooksAPI&) = delete;
+
+    // Raw JSON body of the upstream response, passed through unparsed.
+    // Throws SearchOverloaded, SearchTimeout, or std::runtime_error if the
+    // upstream request fails.
+    SearchCache::Body search(const std::string& query);
+
+    // A resource fetched by URL, such as a cover image.
+    struct Download {
+        std::string body;
+        std::string contentType;
+    };
+    // GET of an arbitrary URL on the same event thread and connections as
+    // search(). Throws SearchTimeout after `deadline`, or
+    // std::runtime_error on failure, a non-200 status, or a body larger
+    // than maxBytes. Redirects are not followed.
+    Download fetch(const std::string& url, size_t maxBytes, std::chrono::milliseconds deadline);
+
+private:
+    // One upstream GET, owned by the event thread while in progress.
+    struct Transfer {
+        std::string url;
+        std::string body;
+        std::string contentType;
+        size_t maxBytes = 0;      // 0 = no limit
+        std::function<void(Transfer& done, int curlCode, long status)> onDone;
+        CURL* handle = nullptr;
+    };
+
+    void submit(std::unique_ptr<Transfer> transfer);
+    void run();
+    void start(std::unique_ptr<Transfer> transfer);
+    void finish(CURL* handle, int curlCode);
+    static size_t onBody(void* contents, size_t size, size_t nmemb, void* transfer);
+
+    Options options;
+    SearchCache cache;
+
+    std::mutex inflightMutex;
+    std::unordered_map<std::string, std::shared_future<SearchCache::Body>> inflight;
+    std::atomic<int> waiting{0};
+
+    // Event thread state
+    CURLM* multi = nullptr;
+    std::mutex queueMutex;
+    std::vector<std::unique_ptr<Transfer>> queued;
+    std::unordered_map<CURL*, std::unique_ptr<Transfer>> active;
+    std::vector<CURL*> idleHandles;    // only touched by the event thread
+    std::atomic<bool> stopping{false};
+    std::thread loop;
 };
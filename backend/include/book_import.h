@@ -0,0 +1,74 @@
+#pragma once
+#include "database.h"
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Incremental parser for bulk book uploads. Bytes are fed as they arrive
+// from the socket; complete rows are validated into NewBooks and handed to
+// the flush callback in batches, so memory stays bounded by the batch
+// size whatever the upload size.
+//
+// CSV needs a header row naming the columns (title, author, genre, status,
+// pagesRead, totalPages, notes, tags, goalEndDate, thumbnail, rating;
+// snake_case also accepted). JSON lines takes one object per line with the
+// same keys as POST /api/books.
+class BookImporter {
+public:
+    enum class Format { Csv, JsonLines };
+    // Receives a full batch; may throw to abort the import.
+    using Flush = std::function<void(const std::vector<NewBook>& batch)>;
+
+    struct RowError {
+        size_t row;              // 1-based line (or CSV record) number
+        std::string message;
+    };
+
+    BookImporter(Format format, Flush flush, size_t batchSize = 5000);
+
+    void feed(const char* data, size_t size);
+    // Ends the input: parses any trailing row and flushes the last batch.
+    void finish();
+
+    size_t imported() const { return importedCount; }
+    size_t failed() const { return failedCount; }
+    // The first maxReportedErrors row errors.
+    const std::vector<RowError>& errors() const { return rowErrors; }
+
+    static constexpr size_t maxReportedErrors = 100;
+    static constexpr size_t maxRowBytes = 1 << 20;
+
+private:
+    void feedCsv(const char* data, size_t size);
+    void endCsvField();
+    void endCsvRecord();
+    void endJsonLine();
+    void accept(NewBook&& book);
+    void reject(std::string message);
+    void flushBatch();
+
+    Format format;
+    Flush flush;
+    size_t batchSize;
+    std::vector<NewBook> batch;
+
+    size_t row = 1;
+    size_t rowBytes = 0;
+    bool overlong = false;
+    size_t importedCount = 0;
+    size_t failedCount = 0;
+    std::vector<RowError> rowErrors;
+
+    // CSV state; the row's fields are kept across feed() calls.
+    std::string field;
+    std::vector<std::string> record;
+    bool inQuotes = false;
+    bool afterQuote = false;
+    bool haveHeader = false;
+    bool badHeader = false;
+    std::vector<int> columns;    // CSV column -> NewBook field, -1 = ignored
+
+    // JSON lines state
+    std::string line;
+};
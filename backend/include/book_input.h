@@ -0,0 +1,69 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A book's fields as sent to POST /api/books and PUT /api/books/:id. The
+// text fields view the request body, or the parser's arena for strings
+// that had escapes to decode, so both must outlive the BookInput.
+struct BookInput {
+    std::string_view title;
+    std::string_view author;
+    std::string_view genre;
+    std::string_view status = "Not Started";
+    int pagesRead = 0;
+    int totalPages = 0;
+    std::string_view notes;
+    std::string_view tags;
+    std::string_view goalEndDate;
+    std::string_view thumbnail;
+    int rating = 3;
+};
+
+// Field rules shared by the API and the bulk importer: known status,
+// non-negative page counts, rating 0-5, and a title for new books. Returns
+// the problem, or nullptr if the book is acceptable.
+const char* checkBook(const BookInput& book, bool requireTitle);
+
+// Reads one JSON object straight into a BookInput, without building a
+// document. Unknown keys are skipped and null leaves a field's default.
+// Strings without escapes are returned as views of the input, so a typical
+// request allocates nothing. Use one parser per request.
+class BookInputParser {
+public:
+    // Longest accepted text field, in bytes after unescaping
+    static constexpr size_t maxTextBytes = 64 * 1024;
+
+    // Fills `out` from `body`. Returns false, with error() saying why, if
+    // the body is not a JSON object, a field has the wrong type, or a value
+    // is too long or out of range. Does not apply checkBook.
+    bool parse(std::string_view body, BookInput& out);
+    const std::string& error() const { return problem; }
+
+private:
+    // Bump allocator for decoded strings: a fixed buffer first, then heap
+    // blocks kept until the parser goes away.
+    class Arena {
+    public:
+        char* allocate(size_t size);
+
+    private:
+        char buffer[1024];
+        size_t used = 0;
+        std::vector<std::unique_ptr<char[]>> blocks;
+    };
+
+    bool fail(std::string message);
+    void skipSpace();
+    bool parseString(std::string_view& out);
+    bool parseInt(std::string_view key, int& out);
+    bool skipValue(int depth);
+    bool parseField(std::string_view key, BookInput& out);
+
+    const char* p = nullptr;
+    const char* end = nullptr;
+    Arena arena;
+    std::string problem;
+};
@@ -0,0 +1,68 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct z_stream_s;
+#ifdef BOOKTRACKER_HAVE_ZSTD
+struct ZSTD_CCtx_s;
+#endif
+
+// Content-Encoding for dynamic (API) responses.
+enum class Coding { Identity, Gzip, Zstd };
+
+// An Accept-Encoding header, parsed. q-values only decide whether a
+// coding is acceptable; callers rank the acceptable ones themselves.
+class AcceptEncoding {
+public:
+    explicit AcceptEncoding(const std::string& header);
+    // Listed with q > 0, or not listed and "*" has q > 0. coding is lower
+    // case; x-gzip counts as gzip.
+    bool accepts(const std::string& coding) const;
+
+private:
+    std::vector<std::pair<std::string, double>> codings;
+    double any = -1;
+};
+
+// Best coding the client accepts, from an Accept-Encoding header. zstd
+// is only offered when the server was built with it.
+Coding negotiateCoding(const std::string& acceptEncoding);
+const char* codingName(Coding coding);
+
+// A reusable compression stream. Each thread keeps one per coding (see
+// local()), so a request only resets an existing context instead of
+// allocating one.
+class Compressor {
+public:
+    using Sink = std::function<bool(const char* data, size_t size)>;
+
+    explicit Compressor(Coding coding);
+    ~Compressor();
+    Compressor(const Compressor&) = delete;
+    Compressor& operator=(const Compressor&) = delete;
+
+    // This thread's compressor for coding; not Identity.
+    static Compressor& local(Coding coding);
+
+    // Starts a new stream.
+    void reset();
+    // Compresses data and hands any output to out; finish ends the stream
+    // and flushes everything. Returns false if out did, or on a codec
+    // error.
+    bool write(const char* data, size_t size, bool finish, const Sink& out);
+    // Replaces body with its compressed form in one stream. out is
+    // scratch space that keeps its capacity from call to call.
+    bool compress(std::string& body, std::string& out);
+
+private:
+    const Coding coding;
+    z_stream_s* zlib = nullptr;
+#ifdef BOOKTRACKER_HAVE_ZSTD
+    ZSTD_CCtx_s* zstd = nullptr;
+#endif
+    std::array<char, 16 * 1024> buffer;
+};
@@ -0,0 +1,111 @@
+#pragma once
+#include <SQLiteCpp/SQLiteCpp.h>
+#include <sqlite3.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Borrowed reference to a cached prepared statement. Resets the statement
+// when it goes out of scope so it never pins a read snapshot between calls,
+// and clears its bindings so it never points into text bound without a
+// copy (see sql::bindValue) once the caller's buffers are gone.
+class StatementRef {
+public:
+    explicit StatementRef(SQLite::Statement& stmt) : stmt(&stmt) {}
+    StatementRef(StatementRef&& other) noexcept : stmt(other.stmt) { other.stmt = nullptr; }
+    StatementRef(const StatementRef&) = delete;
+    StatementRef& operator=(const StatementRef&) = delete;
+    ~StatementRef() {
+        if (!stmt) return;
+        stmt->tryReset();
+        sqlite3_clear_bindings(stmt->getPreparedStatement());
+    }
+
+    SQLite::Statement& operator*() const { return *stmt; }
+    SQLite::Statement* operator->() const { return stmt; }
+
+private:
+    SQLite::Statement* stmt;
+};
+
+// One SQLite connection plus the statements prepared on it. A connection
+// is only ever used by the thread holding its lease, so the cache needs
+// no locking of its own.
+class Connection : public SQLite::Database {
+public:
+    Connection(const std::string& dbPath, int flags);
+
+    // Returns the statement for `query`, preparing it on first use; a
+    // reused one comes back reset with no bindings. `query` is the cache
+    // key, so callers should pass the same literal each time.
+    StatementRef prepare(std::string_view query);
+
+private:
+    // Keys view into each statement's own copy of its SQL text.
+    std::unordered_map<std::string_view, std::unique_ptr<SQLite::Statement>> statements;
+};
+
+// Owns every SQLite connection to one database file: a single writer
+// serialized by a mutex, plus a fixed set of read-only connections that
+// callers check out for the duration of a query. The file runs in WAL
+// mode, so readers see the last committed state without waiting on the
+// writer.
+class ConnectionPool {
+public:
+    // No read-only connection came free within readerTimeout.
+    class Busy : public std::runtime_error {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    // Longest reader() waits. Streamed responses hold a reader until the
+    // client has read the last byte, so a wait has no natural end.
+    static constexpr std::chrono::milliseconds readerTimeout{2000};
+    // Scoped handle to a checked-out connection, returned on destruction.
+    class Lease {
+    public:
+        Lease(Lease&& other) noexcept;
+        Lease& operator=(Lease&&) = delete;
+        Lease(const Lease&) = delete;
+        ~Lease();
+
+        Connection& operator*() const { return *conn; }
+        Connection* operator->() const { return conn; }
+
+    private:
+        friend class ConnectionPool;
+        Lease(ConnectionPool* pool, Connection* conn);
+        Lease(Connection* conn, std::unique_lock<std::mutex> lock);
+
+        ConnectionPool* pool = nullptr;      // set for read leases
+        Connection* conn = nullptr;
+        std::unique_lock<std::mutex> writeLock;
+    };
+
+    // readerCount == 0 picks one reader per hardware thread.
+    explicit ConnectionPool(const std::string& dbPath, size_t readerCount = 0);
+
+    // Blocks until a read-only connection is free; throws Busy after
+    // readerTimeout.
+    Lease reader();
+    // Blocks until the writer connection is free.
+    Lease writer();
+
+private:
+    void release(Connection* conn);
+
+    std::mutex writeMutex;
+    std::unique_ptr<Connection> writeConn;
+
+    std::mutex readMutex;
+    std::condition_variable readAvailable;
+    std::vector<std::unique_ptr<Connection>> readConns;
+    std::vector<Connection*> idleReaders;
+};
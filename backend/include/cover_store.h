@@ -0,0 +1,90 @@
+#pragma once
+#include "api.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A stored cover mapped into memory; unmapped when the last user drops it.
+class MappedCover {
+public:
+    MappedCover(const char* data, size_t size, std::string contentType)
+        : data(data), size(size), contentType(std::move(contentType)) {}
+    ~MappedCover();
+    MappedCover(const MappedCover&) = delete;
+    MappedCover& operator=(const MappedCover&) = delete;
+
+    const char* const data;
+    const size_t size;
+    const std::string contentType;
+};
+
+// Book cover images kept on disk under the SHA-256 of their bytes, so a
+// cover shared by many books or users is fetched and stored once.
+// Remote URLs are fetched through GoogleBooksAPI on first use, and the
+// URL -> hash index is appended to <root>/urls so it survives restarts.
+// When the store grows past maxBytes, the least recently served covers
+// are deleted; their URLs are fetched again if asked for.
+//
+// Layout: <root>/objects/<first two hex digits>/<hash>.
+class CoverStore {
+public:
+    struct Options {
+        std::string root;
+        uintmax_t maxBytes = 256ull << 20;
+        size_t maxCoverBytes = 2 << 20;
+        // Only URLs starting with one of these are fetched, so the
+        // endpoint cannot be used as an open proxy.
+        std::vector<std::string> allowedPrefixes = {
+            "http://books.google.com/books/content",
+            "https://books.google.com/books/content",
+        };
+        std::chrono::milliseconds fetchDeadline = std::chrono::seconds(5);
+    };
+
+    CoverStore(Options options, GoogleBooksAPI& api);
+
+    // Hash of the cover at url, fetching and storing it first if needed.
+    // Concurrent calls for the same URL share one fetch. Throws
+    // std::invalid_argument for URLs outside allowedPrefixes or bodies
+    // that are not images, and GoogleBooksAPI::fetch's errors otherwise.
+    std::string resolve(const std::string& url);
+
+    // The stored cover, or null if hash is unknown or was evicted.
+    std::shared_ptr<const MappedCover> open(const std::string& hash);
+
+    static bool isHash(const std::string& s);
+
+private:
+    struct Entry {
+        uintmax_t size;
+        std::list<std::string>::iterator lru;
+        std::shared_ptr<const MappedCover> mapped;    // mapped on first open
+    };
+
+    std::string objectPath(const std::string& hash) const;
+    void loadIndex();
+    std::string store(const std::string& url, GoogleBooksAPI::Download download);
+    // Caller holds mutex.
+    void touch(Entry& entry);
+    void evict();
+
+    const Options options;
+    GoogleBooksAPI& api;
+
+    std::mutex mutex;
+    std::unordered_map<std::string, Entry> entries;
+    std::list<std::string> lru;                // most recently used first
+    uintmax_t totalBytes = 0;
+    std::unordered_map<std::string, std::string> urls;    // url -> hash
+    std::ofstream urlLog;
+    std::unordered_map<std::string, std::shared_future<std::string>> inflight;
+};
@@ -1,67 +1,167 @@
 #pragma once
-#include <SQLiteCpp/SQLiteCpp.h>
-#include <nlohmann/json.hpp>
+#include "connection_pool.h"
+#include "id_allocator.h"
+#include "session_cache.h"
+#include "shard.h"
+#include <array>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <shared_mutex>
+#include <stdexcept>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
-// Represents a single reading session
-struct ReadingSession {
-    int id;
-    int bookId;
-    std::string startTime;
-    std::string endTime;
-    int pagesRead;
-};
-
+// The BookTracker store, split so that write throughput grows with the
+// number of shard files. A small directory database holds accounts, login
+// sessions, each user's shard and the id sequences; a user's books,
+// reading sessions and aggregates all live on their shard. New users are
+// placed by a stable hash of their id, and the placement is recorded, so
+// changing the shard count only affects later signups.
+//
+// Layout under dataDir: directory.sqlite, shard-00.sqlite, shard-01.sqlite,
+// ..., and process.lock.
+//
+// One server process per data directory. Placements, the session cache and
+// ETag versions are cached in memory and not re-read from the files, so a
+// second process would miss moves, logouts and version bumps made by the
+// first. Each process holds a read lock on process.lock: opening the
+// directory while another process has it logs a warning, and moveUser
+// refuses to run.
+//
+// Thread-safe. Per-user methods behave as documented on Shard.
 class Database {
 public:
-    explicit Database(const std::string& dbPath);
+    // moveUser found another process using the data directory.
+    class MoveConflict : public std::runtime_error {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    struct Options {
+        int shards = 4;
+        // The single database used before sharding. If dataDir has no
+        // shard 0 yet, this file becomes it: its users and sessions are
+        // copied into the directory, and its users stay on shard 0 until
+        // moved.
+        std::string legacyPath;
+        // Read-only connections per shard; 0 picks one per hardware
+        // thread. The stream* methods hold one for the whole response, and
+        // any one shard may be serving every stream, so this must be at
+        // least the Read pool's concurrency plus room for short reads, or
+        // slow clients starve other requests of connections.
+        size_t readers = 0;
+    };
+
+    explicit Database(const std::string& dataDir);
+    Database(const std::string& dataDir, const Options& options);
+    ~Database();
+    Database(const Database&) = delete;
+    Database& operator=(const Database&) = delete;
 
     // Book methods scoped per user
-    nlohmann::json getBooks(int userId);
-    void addBook(int userId,
-                 const std::string& title,
-                 const std::string& author,
-                 const std::string& genre,
-                 const std::string& status,
-                 int pagesRead,
-                 int totalPages,
-                 const std::string& notes,
-                 const std::string& tags,
-                 const std::string& goalEndDate,
-                 const std::string& thumbnail,
-                 int rating);
-    void updateBook(int id, int userId,
-                    const std::string& status,
-                    int pagesRead,
-                    int totalPages,
-                    const std::string& notes,
-                    const std::string& tags,
-                    const std::string& goalEndDate,
-                    const std::string& thumbnail,
-                    int rating);
+
+    bool streamBooks(int userId, const BookQuery& query, const JsonWriter::Sink& sink);
+    bool streamChanges(int userId, int64_t since, const JsonWriter::Sink& sink);
+    bool streamSearch(int userId, const std::string& text, int limit, int offset,
+                      const JsonWriter::Sink& sink);
+    void addBook(int userId, const BookInput& book);
+    void importBooks(int userId, const std::vector<NewBook>& books);
+    void updateBook(int id, int userId, const BookInput& book);
     void deleteBook(int id, int userId);
 
+    LibraryStats getAnalytics(int userId);
+    // Recounts every shard. Returns how many users' aggregates had drifted.
+    int rebuildAnalytics();
+
+    int64_t dataVersion(int userId);
+
     // Reading‑session methods
-    void startReadingSession(int userId,
+    bool startReadingSession(int userId,
                              int bookId,
                              const std::string& startTime,
                              int startPagesRead,
                              int& outSessionId);
-    void stopReadingSession(int sessionId,
+    bool stopReadingSession(int userId,
+                            int bookId,
+                            int sessionId,
                             const std::string& endTime,
                             int endPagesRead);
     std::vector<ReadingSession> getReadingSessions(int userId);
+    ReadingSummary getReadingSummary(int userId,
+                                     const std::string& from,
+                                     const std::string& to,
+                                     const std::string& today);
 
-    // User & session methods
+    // User & session methods, answered by the directory
     bool createUser(const std::string& username, const std::string& passwordHash);
     std::optional<std::pair<int, std::string>> getUserByUsername(const std::string& username);
     void createSession(const std::string& token, int userId, const std::string& expiresAt);
     std::optional<int> getUserIdBySession(const std::string& token);
     void deleteSession(const std::string& token);
 
+    // Sharding
+
+    int shardCount() const { return static_cast<int>(shards.size()); }
+    // Shard holding the user's library; cached after the first lookup.
+    int shardOf(int userId);
+    // Moves the user's library to shard `to` while the server runs. The
+    // user's calls wait until the move is done, and calls already running
+    // finish first; other users are unaffected. Returns the shard the user
+    // came from. Throws std::invalid_argument for an unknown user or shard,
+    // and MoveConflict if another process has the data directory open.
+    int moveUser(int userId, int to);
+
+    static std::string shardPath(const std::string& dataDir, int shard);
+
 private:
-    SQLite::Database db;
+    // Users are striped over these to count their calls in flight, so a
+    // move can hold off one user and wait for their running calls.
+    struct Stripe {
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::unordered_map<int, int> active;    // user -> calls in flight
+        int moving = 0;                         // user being moved, 0 if none
+    };
+
+    // One call's hold on its user's shard: the user does not move before
+    // it is released.
+    class Pin {
+    public:
+        Pin(Stripe& stripe, int userId, Shard& shard) : stripe(stripe), userId(userId), shard(&shard) {}
+        ~Pin();
+        Pin(const Pin&) = delete;
+        Pin& operator=(const Pin&) = delete;
+
+        Shard* operator->() const { return shard; }
+
+    private:
+        Stripe& stripe;
+        int userId;
+        Shard* shard;
+    };
+
+    Pin pin(int userId);
+    // Drops one pin of the user's, waking a move waiting for the last.
+    static void unpin(Stripe& stripe, int userId);
+    Stripe& stripeOf(int userId) { return stripes[static_cast<unsigned>(userId) % stripes.size()]; }
+    void adoptLegacy(const std::string& legacyPath);
+
+    const std::string dataDir;
+    const int placementShards;     // shards new users are hashed over
+    int processLock = -1;          // fd of process.lock
+
+    ConnectionPool directory;
+    IdAllocator ids;
+    SessionCache sessionCache;     // write-through cache of the sessions table
+    std::vector<std::unique_ptr<Shard>> shards;
+
+    std::shared_mutex placementMutex;
+    std::unordered_map<int, int> placements;    // mirror of users.shard
+
+    std::array<Stripe, 64> stripes;
+    std::mutex moveMutex;          // one move at a time
 };
@@ -0,0 +1,30 @@
+#pragma once
+#include "connection_pool.h"
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Hands out book and reading-session ids that are unique across every
+// shard, so a user's rows keep their ids when they move. Ids are reserved
+// from the directory's id_sequences in blocks, so most calls never touch
+// the database; ids left in a block at exit are simply skipped.
+class IdAllocator {
+public:
+    explicit IdAllocator(ConnectionPool& directory, int64_t blockSize = 1024);
+
+    // First of `count` consecutive unused ids for `sequence` ("books" or
+    // "reading_sessions").
+    int64_t take(const std::string& sequence, int64_t count = 1);
+
+private:
+    struct Block {
+        int64_t next = 0;
+        int64_t end = 0;       // exclusive
+    };
+
+    ConnectionPool& directory;
+    const int64_t blockSize;
+    std::mutex mutex;
+    std::unordered_map<std::string, Block> blocks;
+};
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Compressed set of 32-bit ids in the style of Roaring bitmaps. Ids are
+// grouped by their high 16 bits; each group is a sorted array of low bits
+// while small and a 65536-bit bitset once it passes arrayLimit members, so
+// both sparse and dense sets stay compact and intersect quickly.
+class IdBitmap {
+public:
+    void add(uint32_t id);
+    bool contains(uint32_t id) const;
+    size_t size() const;
+    bool empty() const { return containers.empty(); }
+
+    IdBitmap operator&(const IdBitmap& other) const;
+    IdBitmap& operator|=(const IdBitmap& other);
+
+    // Members in ascending order
+    std::vector<uint32_t> toVector() const;
+
+    static constexpr size_t arrayLimit = 4096;
+
+private:
+    struct Container {
+        std::vector<uint16_t> array;    // sorted; used while bits is empty
+        std::vector<uint64_t> bits;     // 1024 words once dense
+        size_t count = 0;
+
+        bool dense() const { return !bits.empty(); }
+        void add(uint16_t low);
+        bool contains(uint16_t low) const;
+        void toBitset();
+        void toArrayIfSparse();
+    };
+
+    static Container intersect(const Container& a, const Container& b);
+    static void unite(Container& into, const Container& from);
+
+    std::vector<std::pair<uint16_t, Container>> containers;    // by high bits
+};
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+// Writes JSON text into a fixed-size buffer and hands it to a sink each
+// time the buffer fills, so output of any length is produced in
+// bufferSize bytes of memory. No document tree is ever built; callers
+// emit structure and values in order.
+class JsonWriter {
+public:
+    // Returns false to stop the writer, e.g. when the client went away.
+    using Sink = std::function<bool(const char* data, size_t size)>;
+
+    explicit JsonWriter(Sink sink, size_t bufferSize = 16 * 1024);
+
+    // Punctuation and pre-encoded JSON, copied verbatim.
+    JsonWriter& raw(std::string_view text);
+    // Object key including the trailing colon.
+    JsonWriter& key(std::string_view name);
+    // Quoted, escaped string value.
+    JsonWriter& string(std::string_view value);
+    JsonWriter& number(int64_t value);
+    JsonWriter& number(double value);
+
+    // Pushes buffered bytes to the sink. Returns ok().
+    bool flush();
+    // False once the sink has rejected a write; later output is dropped.
+    bool ok() const { return healthy; }
+
+private:
+    void append(const char* data, size_t size);
+
+    Sink sink;
+    std::vector<char> buffer;
+    size_t used = 0;
+    bool healthy = true;
+};
@@ -0,0 +1,129 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Process-wide counters and latency histograms, rendered in the
+// Prometheus text format. Every metric is split into per-thread shards of
+// plain atomics, so recording is one uncontended relaxed add and the
+// shards are only summed when scraped.
+namespace metrics {
+
+constexpr size_t shardCount = 16;
+
+// Index of the calling thread's shard.
+size_t threadShard();
+
+class Counter {
+public:
+    void add(uint64_t n = 1);
+    uint64_t value() const;
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> value{0};
+    };
+    std::array<Shard, shardCount> shards;
+};
+
+// Goes up and down, e.g. requests in flight.
+class Gauge {
+public:
+    void add(int64_t n);
+    int64_t value() const;
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<int64_t> value{0};
+    };
+    std::array<Shard, shardCount> shards;
+};
+
+// Log-linear histogram of durations in microseconds, in the style of
+// HdrHistogram: each power of two is split into subBuckets equal buckets,
+// so any value is placed within 1/subBuckets of its true size.
+class Histogram {
+public:
+    static constexpr int subBits = 3;
+    static constexpr size_t subBuckets = size_t(1) << subBits;
+    // Up to 2^34 us (about 4.7 hours); longer lands in the last bucket.
+    static constexpr size_t bucketCount = subBuckets * 32;
+
+    void record(std::chrono::nanoseconds elapsed);
+    void recordMicros(uint64_t micros);
+
+    // Exclusive upper bound of a bucket, in microseconds.
+    static uint64_t upperBound(size_t bucket);
+    static size_t bucketFor(uint64_t micros);
+
+    struct Snapshot {
+        std::array<uint64_t, bucketCount> counts{};
+        uint64_t count = 0;
+        uint64_t sumMicros = 0;
+    };
+    Snapshot snapshot() const;
+
+private:
+    struct alignas(64) Shard {
+        std::array<std::atomic<uint64_t>, bucketCount> counts{};
+        std::atomic<uint64_t> sumMicros{0};
+    };
+    std::array<Shard, shardCount> shards;
+};
+
+// Times a scope into a histogram.
+class Timer {
+public:
+    explicit Timer(Histogram& histogram)
+        : histogram(histogram), start(std::chrono::steady_clock::now()) {}
+    ~Timer() { histogram.record(std::chrono::steady_clock::now() - start); }
+    Timer(const Timer&) = delete;
+    Timer& operator=(const Timer&) = delete;
+
+private:
+    Histogram& histogram;
+    std::chrono::steady_clock::time_point start;
+};
+
+// Metrics by name and label set. Lookups take a lock, so hot paths look a
+// metric up once (e.g. into a function-local static) and keep the
+// reference, which stays valid for the life of the process.
+class Registry {
+public:
+    // help is recorded the first time a name is seen. labels is the
+    // Prometheus label list without braces, e.g. route="GET /api/books".
+    Counter& counter(const std::string& name, const std::string& help, const std::string& labels = "");
+    Gauge& gauge(const std::string& name, const std::string& help, const std::string& labels = "");
+    Histogram& histogram(const std::string& name, const std::string& help, const std::string& labels = "");
+
+    // Values owned elsewhere, read at scrape time.
+    void gaugeCallback(const std::string& name, const std::string& help, std::function<double()> read);
+
+    std::string prometheus() const;
+
+private:
+    struct Family {
+        std::string type;
+        std::string help;
+        std::map<std::string, std::unique_ptr<Counter>> counters;
+        std::map<std::string, std::unique_ptr<Gauge>> gauges;
+        std::map<std::string, std::unique_ptr<Histogram>> histograms;
+        std::function<double()> callback;
+    };
+
+    Family& family(const std::string& name, const char* type, const std::string& help);
+
+    mutable std::mutex mutex;
+    std::map<std::string, Family> families;
+};
+
+Registry& registry();
+
+} // namespace metrics
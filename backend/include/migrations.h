@@ -0,0 +1,14 @@
+#pragma once
+#include <SQLiteCpp/SQLiteCpp.h>
+
+// Brings a shard's schema up to the latest version. Each numbered
+// migration runs at most once, in its own transaction, and records itself
+// in PRAGMA user_version, so an up-to-date database costs a single pragma
+// read.
+void migrate(SQLite::Database& db);
+
+// Schema version the running binary expects.
+int latestSchemaVersion();
+
+// Same for the directory database, which has its own numbering.
+void migrateDirectory(SQLite::Database& db);
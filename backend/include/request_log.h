@@ -0,0 +1,84 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Access log that keeps I/O off the request path. Each worker thread
+// pushes fixed-size records into its own single-producer ring; a drain
+// thread empties all rings every flushInterval and writes them as JSON
+// lines in one batch. A full ring drops the record and counts it rather
+// than making the worker wait.
+class RequestLog {
+public:
+    struct Record {
+        int64_t timeUs;       // wall clock, microseconds since the epoch
+        uint32_t latencyUs;
+        uint32_t bytes;
+        int32_t userId;       // 0 = anonymous
+        uint16_t status;
+        uint8_t methodLen;
+        uint8_t pathLen;
+        char method[8];
+        char path[96];        // truncated
+    };
+
+    // Writes to `path`, rotating to path.1 .. path.<keepFiles> once it
+    // passes maxFileBytes; an empty path writes to stdout, unrotated.
+    explicit RequestLog(std::string path = "",
+                        size_t maxFileBytes = 64 << 20,
+                        int keepFiles = 5);
+    // Drains what is buffered, then stops the drain thread.
+    ~RequestLog();
+    RequestLog(const RequestLog&) = delete;
+    RequestLog& operator=(const RequestLog&) = delete;
+
+    // Lock-free and allocation-free after the calling thread's first record.
+    void log(std::string_view method, std::string_view path, int status,
+             uint32_t latencyUs, uint64_t bytes, int userId);
+
+    // Records lost to full rings since startup
+    uint64_t dropped() const { return droppedTotal.load(std::memory_order_relaxed); }
+
+    static constexpr size_t ringSize = 1024;    // power of two
+    static constexpr auto flushInterval = std::chrono::milliseconds(50);
+
+private:
+    struct Ring {
+        std::array<Record, ringSize> records;
+        alignas(64) std::atomic<uint64_t> head{0};    // written by the producer
+        alignas(64) std::atomic<uint64_t> tail{0};    // written by the drain thread
+    };
+
+    Ring& threadRing();
+    void run();
+    void drain();
+    void write(const std::string& batch);
+    void rotate();
+
+    const uint64_t instance;    // tells thread-local rings of different logs apart
+    std::string path;
+    size_t maxFileBytes;
+    int keepFiles;
+    FILE* out = nullptr;
+    size_t fileBytes = 0;
+
+    std::mutex ringsMutex;    // only taken when a thread logs for the first time
+    std::vector<std::unique_ptr<Ring>> rings;
+
+    std::atomic<uint64_t> droppedTotal{0};
+    uint64_t droppedReported = 0;
+
+    std::mutex stopMutex;
+    std::condition_variable stopSignal;
+    bool stopping = false;
+    std::thread drainer;
+};
@@ -0,0 +1,97 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace metrics {
+class Counter;
+class Gauge;
+class Histogram;
+}
+
+// Classes of route that must not starve each other.
+enum class RequestClass { Auth, Read, Write, External };
+constexpr size_t requestClassCount = 4;
+
+const char* requestClassName(RequestClass c);
+
+// Admission control for one class of request: at most `concurrency` run
+// at once, up to `queueDepth` more wait for a slot, and anything beyond
+// that is turned away at once.
+class RequestPool {
+public:
+    struct Options {
+        size_t concurrency = 8;
+        size_t queueDepth = 32;
+        std::chrono::milliseconds queueTimeout{2000};   // longest wait for a slot
+    };
+
+    // Held for the life of the request, streamed body included; frees
+    // the slot when the last copy is dropped.
+    class Permit {
+    public:
+        explicit Permit(RequestPool& pool) : pool(pool) {}
+        ~Permit() { pool.release(); }
+        Permit(const Permit&) = delete;
+        Permit& operator=(const Permit&) = delete;
+
+    private:
+        RequestPool& pool;
+    };
+
+    RequestPool(RequestClass requestClass, Options options);
+
+    // Null when the pool is saturated: the queue is full, or no slot
+    // opened up within queueTimeout.
+    std::shared_ptr<Permit> admit();
+
+    const Options& options() const { return opts; }
+
+private:
+    void release();
+
+    const Options opts;
+    std::mutex mutex;
+    std::condition_variable slotFree;
+    size_t active = 0;
+    size_t queued = 0;
+
+    metrics::Gauge& activeGauge;
+    metrics::Gauge& queuedGauge;
+    metrics::Counter& admitted;
+    metrics::Counter& rejectedFull;
+    metrics::Counter& rejectedTimeout;
+    metrics::Histogram& queueWait;
+};
+
+// One RequestPool per RequestClass.
+class Scheduler {
+public:
+    struct Options {
+        RequestPool::Options pools[requestClassCount] = {
+            {8, 32, std::chrono::milliseconds(1000)},    // Auth: logins, health, static files
+            {16, 48, std::chrono::milliseconds(2000)},   // Read
+            {4, 32, std::chrono::milliseconds(5000)},    // Write: one SQLite writer underneath
+            {8, 16, std::chrono::milliseconds(500)},     // External: Google Books proxy
+        };
+    };
+
+    // spec overrides the defaults per class, e.g. "read=32:128,write=2:16"
+    // (concurrency:queueDepth). Returns false on a malformed spec.
+    static bool parse(const std::string& spec, Options& options);
+
+    Scheduler();
+    explicit Scheduler(const Options& options);
+
+    RequestPool& pool(RequestClass c) { return *pools[static_cast<size_t>(c)]; }
+
+    // Server threads needed for every pool to fill its slots and queue at
+    // once, so one saturated class cannot hold every thread.
+    size_t threadBudget() const;
+
+private:
+    std::unique_ptr<RequestPool> pools[requestClassCount];
+};
@@ -0,0 +1,43 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Sharded LRU cache of upstream response bodies with a fixed time to live.
+// Bodies are shared immutable buffers, so a hit hands out the cached bytes
+// without copying them.
+class SearchCache {
+public:
+    using Body  = std::shared_ptr<const std::string>;
+    using Clock = std::chrono::steady_clock;
+
+    SearchCache(size_t capacity, Clock::duration ttl);
+
+    // Null on a miss or an expired entry.
+    Body get(const std::string& key);
+    void put(const std::string& key, Body body);
+
+private:
+    struct Entry {
+        std::string key;
+        Body body;
+        Clock::time_point expiresAt;
+    };
+    struct Shard {
+        std::mutex mutex;
+        std::list<Entry> lru;    // most recently used first
+        std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    };
+
+    Shard& shardFor(const std::string& key);
+
+    static constexpr size_t shardCount = 16;
+    std::array<Shard, shardCount> shards;
+    size_t shardCapacity;
+    Clock::duration ttl;
+};
@@ -0,0 +1,25 @@
+#pragma once
+#include "api.h"
+#include "cover_store.h"
+#include "database.h"
+#include "request_log.h"
+#include "scheduler.h"
+#include "static_assets.h"
+#include "httplib.h"
+
+// Installs request logging, metrics, compression and every /api route on
+// svr, each route admitted through its scheduler pool. Static files and
+// listen() are left to the caller. db, api, requestLog, scheduler and
+// covers must outlive the server.
+void registerRoutes(httplib::Server& svr, Database& db, GoogleBooksAPI& api, RequestLog& requestLog,
+                    Scheduler& scheduler, CoverStore& covers);
+
+// Operator endpoints, /api/metrics included, authorized by
+// "Authorization: Bearer <token>". Only call this with a non-empty token.
+// db and scheduler must outlive the server.
+void registerAdminRoutes(httplib::Server& svr, Database& db, const std::string& token, Scheduler& scheduler);
+
+// Serves the in-memory frontend for every GET no earlier route claimed,
+// so call it after registerRoutes. assets and pool must outlive the
+// server.
+void registerStaticAssets(httplib::Server& svr, const StaticAssets& assets, RequestPool& pool);
@@ -0,0 +1,65 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Concurrent token -> (user id, expiry) map in front of the sessions table.
+// Tokens are also filed in a hashed timer wheel by expiry time, so expired
+// entries are evicted a slot at a time as the clock moves instead of by
+// scanning the map.
+class SessionCache {
+public:
+    // The wheel spans slotSeconds * slotCount; tokens expiring further out
+    // stay in their slot until a later lap reaches them.
+    explicit SessionCache(std::time_t slotSeconds = 300, size_t slotCount = 2048);
+
+    void put(const std::string& token, int userId, std::time_t expiresAt);
+    void erase(const std::string& token);
+
+    // Filling from the database races with logout: a row read just before
+    // the DELETE must not be cached after erase(). Take generation() before
+    // the read and pass it to fill(), which skips the put if the token's
+    // shard has seen an erase since.
+    uint64_t generation(const std::string& token);
+    void fill(const std::string& token, int userId, std::time_t expiresAt, uint64_t generation);
+
+    // Result of a lookup: Miss means the cache has no opinion and the
+    // caller should consult the database.
+    enum class Status { Hit, Expired, Miss };
+    struct Lookup {
+        Status status;
+        int userId;
+    };
+    Lookup get(const std::string& token, std::time_t now);
+
+private:
+    struct Entry {
+        int userId;
+        std::time_t expiresAt;
+    };
+    struct Shard {
+        std::shared_mutex mutex;
+        std::unordered_map<std::string, Entry> entries;
+        uint64_t erasures = 0;
+    };
+
+    Shard& shardFor(const std::string& token);
+    // Files the token in the wheel slot for its expiry.
+    void file(const std::string& token, std::time_t expiresAt);
+    void advance(std::time_t now);
+
+    std::array<Shard, 16> shards;
+
+    const std::time_t slotSeconds;
+    std::mutex wheelMutex;
+    std::vector<std::vector<std::string>> slots;
+    std::atomic<long long> wheelTick;    // next slot index (in slotSeconds units) to expire
+};
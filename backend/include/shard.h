@@ -0,0 +1,193 @@
+#pragma once
+#include "analytics.h"
+#include "book_input.h"
+#include "connection_pool.h"
+#include "id_allocator.h"
+#include "json_writer.h"
+#include "tag_index.h"
+#include "write_behind.h"
+#include <SQLiteCpp/SQLiteCpp.h>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Represents a single reading session
+struct ReadingSession {
+    int id;
+    int bookId;
+    std::string startTime;
+    std::string endTime;
+    int pagesRead;
+};
+
+// A book to insert, as accepted by POST /api/books and the bulk importer
+struct NewBook {
+    std::string title;
+    std::string author;
+    std::string genre;
+    std::string status = "Not Started";
+    int pagesRead = 0;
+    int totalPages = 0;
+    std::string notes;
+    std::string tags;
+    std::string goalEndDate;
+    std::string thumbnail;
+    int rating = 3;
+};
+
+// Pages read on one day (YYYY-MM-DD, UTC), summed over the sessions
+// started that day
+struct DailyReading {
+    std::string day;
+    int64_t pages;
+    int64_t sessions;
+    int64_t seconds;
+};
+
+struct ReadingSummary {
+    std::vector<DailyReading> days;    // only days with a stopped session
+    int streak = 0;                    // consecutive days with pages, ending today
+};
+
+// Listing options for streamBooks, from the /api/books query string
+struct BookQuery {
+    enum class Sort { Id, Title, Progress, Rating };
+
+    std::string status;        // only books with this status; empty = all
+    std::vector<std::string> tags;    // only books with these tags (see splitTags)
+    bool anyTag = false;              // any of the tags rather than all
+    Sort sort = Sort::Id;
+    bool descending = false;
+    int limit = 0;             // page size; 0 = whole library as a bare array
+
+    // Keyset position: the page starts after the book with this sort
+    // value and id.
+    bool hasCursor = false;
+    std::string afterKey;
+    int afterId = 0;
+
+    // Decodes a nextCursor from a previous page. Returns false if it is
+    // malformed or was issued for a different sort key.
+    bool setCursor(const std::string& cursor);
+};
+
+// One shard file holding the libraries (books, reading sessions and their
+// aggregates) of the users placed on it; Database routes each call to the
+// user's shard. Thread-safe: reads run on pooled read-only connections,
+// writes are serialized through the pool's single writer connection, and
+// shards never share a lock.
+class Shard {
+public:
+    // ids issues the ids of new books and reading sessions. readers sizes
+    // the read-only connection pool (see Database::Options::readers).
+    Shard(const std::string& path, IdAllocator& ids, size_t readers = 0);
+
+    // Book methods scoped per user
+
+    // The stream* methods write from an open cursor and so hold a read
+    // connection until the sink has taken the last row, however slowly
+    // the client reads.
+
+    // Streams the user's books straight from the cursor: a bare JSON array,
+    // or with query.limit set, {"books":[...],"nextCursor":...}. Returns
+    // false if the sink stopped accepting data.
+    bool streamBooks(int userId, const BookQuery& query, const JsonWriter::Sink& sink);
+    // Streams {"version":V,"books":[...],"deleted":[ids]}: rows inserted
+    // or updated and ids deleted after version `since`, as of version V.
+    // Deletions are kept for 90 days; if some after `since` were pruned,
+    // streams {"version":V,"resync":true,"books":[every book],"deleted":[]}
+    // and the client replaces its copy.
+    bool streamChanges(int userId, int64_t since, const JsonWriter::Sink& sink);
+    // Streams {"books":[...],"nextOffset":N|null}: the user's books
+    // matching every word of `text` (each as a prefix) in title, author,
+    // notes or tags, best bm25 match first. Text without words matches
+    // nothing. Returns false if the sink stopped accepting data.
+    bool streamSearch(int userId, const std::string& text, int limit, int offset,
+                      const JsonWriter::Sink& sink);
+    // The book's text is bound in place, without copies.
+    void addBook(int userId, const BookInput& book);
+    // Inserts all books in one transaction with one version bump and one
+    // analytics update.
+    void importBooks(int userId, const std::vector<NewBook>& books);
+    // Queued write-behind and committed with other updates within a few
+    // milliseconds; the user's own reads below wait for it.
+    // Only status, page counts, notes, tags, goal date, thumbnail and rating
+    // are updated. The text is copied into the queue.
+    void updateBook(int id, int userId, const BookInput& book);
+    void deleteBook(int id, int userId);
+
+    // Status counts, genre histogram and rating/page totals, read from the
+    // incrementally maintained aggregates without touching books.
+    LibraryStats getAnalytics(int userId);
+    // Recomputes all aggregates from books. Returns how many users' stored
+    // aggregates disagreed with the recount.
+    int rebuildAnalytics();
+
+    // Monotonic counter bumped by every write to the user's books or
+    // reading sessions; served from memory after the first call.
+    int64_t dataVersion(int userId);
+
+    // Reading‑session methods
+    // Returns false if the book does not belong to the user.
+    bool startReadingSession(int userId,
+                             int bookId,
+                             const std::string& startTime,
+                             int startPagesRead,
+                             int& outSessionId);
+    // Closes an open session of the user's on bookId and rolls it into
+    // reading_daily. Returns false if there is no such open session; throws
+    // std::invalid_argument if endPagesRead is below the session's start.
+    bool stopReadingSession(int userId,
+                            int bookId,
+                            int sessionId,
+                            const std::string& endTime,
+                            int endPagesRead);
+    std::vector<ReadingSession> getReadingSessions(int userId);
+    // Daily totals for from..to (inclusive) from the rollup, plus the
+    // streak ending on `today`. Cost grows with the days covered, not with
+    // the number of sessions.
+    ReadingSummary getReadingSummary(int userId,
+                                     const std::string& from,
+                                     const std::string& to,
+                                     const std::string& today);
+
+    // Moving users between shards (see Database::moveUser)
+
+    // Returns once the user's queued updates are committed.
+    void flushUser(int userId);
+    // Replaces whatever this shard holds for the user with their rows from
+    // the shard file at sourcePath, in one transaction.
+    void copyUser(int userId, const std::string& sourcePath);
+    // Deletes the user's rows, in one transaction.
+    void dropUser(int userId);
+
+    const std::string& path() const { return filePath; }
+
+private:
+    // Dictionary ids of tag names, -1 for names never used.
+    std::vector<int> tagIds(const std::vector<std::string>& names);
+    // Commit callback of writeBehind: applies a group of updates in one
+    // transaction.
+    void commitUpdates(const std::vector<BookUpdate>& group);
+    // Increments user_versions inside the caller's write transaction.
+    int64_t bumpVersion(Connection& conn, int userId);
+    // Makes a committed version visible to dataVersion.
+    void publishVersion(int userId, int64_t version);
+    // Drops the user's cached version and tag bitmaps after their rows
+    // were replaced wholesale.
+    void forgetUser(int userId);
+
+    const std::string filePath;
+    IdAllocator& ids;
+    ConnectionPool pool;
+    TagIndex tagIndex;
+
+    std::mutex versionMutex;
+    std::unordered_map<int, int64_t> versions;  // mirror of user_versions
+
+    // Declared last: destroyed first, committing what is pending while the
+    // pool and version map still exist.
+    WriteBehindQueue writeBehind;
+};
@@ -0,0 +1,61 @@
+#pragma once
+#include <SQLiteCpp/SQLiteCpp.h>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <tuple>
+
+// Compile-time helpers for binding parameters and reading rows by
+// position, so hot queries never look columns up by name.
+namespace sql {
+
+inline void bindValue(SQLite::Statement& q, int index, int value)                { q.bind(index, value); }
+inline void bindValue(SQLite::Statement& q, int index, int64_t value)            { q.bind(index, value); }
+inline void bindValue(SQLite::Statement& q, int index, double value)             { q.bind(index, value); }
+inline void bindValue(SQLite::Statement& q, int index, const std::string& value) { q.bind(index, value); }
+inline void bindValue(SQLite::Statement& q, int index, const char* value)        { q.bind(index, value); }
+
+// Bound without a copy (SQLITE_STATIC), so the text must stay alive until
+// the statement is stepped for the last time. Statements from
+// Connection::prepare drop the binding when their StatementRef goes away.
+inline void bindValue(SQLite::Statement& q, int index, std::string_view value) {
+    // A null data pointer would bind NULL rather than ''
+    int rc = sqlite3_bind_text(q.getPreparedStatement(), index, value.empty() ? "" : value.data(),
+                               static_cast<int>(value.size()), SQLITE_STATIC);
+    if (rc != SQLITE_OK) throw SQLite::Exception(sqlite3_db_handle(q.getPreparedStatement()), rc);
+}
+
+// Binds args to parameters 1..N in order.
+template <typename... Args>
+void bind(SQLite::Statement& q, const Args&... args) {
+    int index = 0;
+    (bindValue(q, ++index, args), ...);
+}
+
+inline void readValue(const SQLite::Column& c, int& out)         { out = c.getInt(); }
+inline void readValue(const SQLite::Column& c, int64_t& out)     { out = c.getInt64(); }
+inline void readValue(const SQLite::Column& c, double& out)      { out = c.getDouble(); }
+inline void readValue(const SQLite::Column& c, std::string& out) { out.assign(c.getText(), c.getBytes()); }
+
+// Specialize with `static constexpr auto fields = std::make_tuple(&T::a, ...)`
+// listing members in SELECT column order.
+template <typename T>
+struct Columns;
+
+// Reads the current row of q into a T, column i into Columns<T> field i.
+template <typename T>
+void readRow(const SQLite::Statement& q, T& row) {
+    std::apply([&](auto... fields) {
+        int index = 0;
+        (readValue(q.getColumn(index++), row.*fields), ...);
+    }, Columns<T>::fields);
+}
+
+template <typename T>
+T readRow(const SQLite::Statement& q) {
+    T row{};
+    readRow(q, row);
+    return row;
+}
+
+} // namespace sql
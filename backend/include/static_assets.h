@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// One frontend file held in memory, with its precompressed variants.
+struct StaticAsset {
+    enum class Encoding { Identity, Gzip, Brotli };
+
+    std::string contentType;
+    std::string version;       // content hash, hex
+    std::string identity;
+    std::string gzip;          // empty when compression did not pay off
+    std::string brotli;
+
+    // Cache validation inputs; unchanged files are reused across reloads.
+    uintmax_t fileSize = 0;
+    std::time_t modified = 0;
+
+    const std::string& body(Encoding encoding) const;
+    // Strong ETag of one encoded variant, e.g. "\"<version>-br\"".
+    std::string etag(Encoding encoding) const;
+};
+
+// The frontend directory loaded into memory at startup. HTML pages have
+// their references to other assets rewritten to "name?v=<version>", so
+// those can be cached for a year while the pages themselves revalidate.
+// An inotify watcher reloads the tree shortly after anything in it
+// changes; requests keep using the previous snapshot until the new one is
+// swapped in.
+class StaticAssets {
+public:
+    explicit StaticAssets(std::string root);
+    ~StaticAssets();
+    StaticAssets(const StaticAssets&) = delete;
+    StaticAssets& operator=(const StaticAssets&) = delete;
+
+    // path is the URL path; "/" and directories map to their index.html.
+    // Returns null for anything not under the root.
+    std::shared_ptr<const StaticAsset> find(const std::string& path) const;
+
+    // Best variant the client accepts, from an Accept-Encoding header.
+    static StaticAsset::Encoding negotiate(const std::string& acceptEncoding, const StaticAsset& asset);
+
+private:
+    using Snapshot = std::unordered_map<std::string, std::shared_ptr<const StaticAsset>>;
+
+    void reload();
+    void watch();
+
+    const std::string root;
+
+    mutable std::mutex snapshotMutex;
+    std::shared_ptr<const Snapshot> snapshot;
+
+    int inotifyFd = -1;
+    int stopFd = -1;           // eventfd that wakes the watcher for shutdown
+    std::thread watcher;
+};
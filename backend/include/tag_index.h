@@ -0,0 +1,62 @@
+#pragma once
+#include "connection_pool.h"
+#include "id_bitmap.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Tags as stored in books.tags: comma-separated, compared trimmed and
+// lowercased. Duplicates are dropped, first occurrence order kept.
+std::vector<std::string> splitTags(const std::string& text);
+
+// Writes book_tags rows inside one write transaction, interning new names
+// into the tags dictionary. Ids are remembered, so a batch interns each
+// name once.
+class TagWriter {
+public:
+    explicit TagWriter(Connection& conn);
+
+    // Tags of a book just inserted
+    void add(int userId, int64_t bookId, const std::string& text);
+    // Replaces the book's tags
+    void replace(int userId, int64_t bookId, const std::string& text);
+
+private:
+    int64_t intern(const std::string& name);
+
+    Connection& conn;
+    std::unordered_map<std::string, int64_t> ids;
+};
+
+// In-memory tag -> book id bitmaps per user, built from book_tags on first
+// use and dropped whenever one of the user's books changes tags, so tag
+// queries are bitmap operations instead of joins.
+class TagIndex {
+public:
+    // Calls back with every (tag id, book id) pair of the user.
+    using Loader = std::function<void(int userId, const std::function<void(int tagId, int64_t bookId)>& row)>;
+
+    explicit TagIndex(Loader loader);
+
+    // Ids of the user's books carrying all (or, with matchAny, any) of
+    // the tags.
+    std::vector<uint32_t> books(int userId, const std::vector<int>& tagIds, bool matchAny);
+
+    // Call after committing a change to the user's book_tags.
+    void invalidate(int userId);
+
+private:
+    using UserTags = std::unordered_map<int, IdBitmap>;
+
+    std::shared_ptr<const UserTags> load(int userId);
+
+    Loader loader;
+    std::mutex mutex;
+    std::unordered_map<int, std::shared_ptr<const UserTags>> users;
+    // Bumped by invalidate, so a load that raced a change is not cached.
+    std::unordered_map<int, uint64_t> generations;
+};
@@ -0,0 +1,109 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Full replacement of a book's editable fields, as sent by PUT /api/books/:id
+struct BookUpdate {
+    int id;
+    int userId;
+    std::string status;
+    int pagesRead;
+    int totalPages;
+    std::string notes;
+    std::string tags;
+    std::string goalEndDate;
+    std::string thumbnail;
+    int rating;
+};
+
+// Write-behind buffer for book updates. Updates to the same (user, book)
+// coalesce to the latest one, and a committer thread hands everything
+// pending to the commit callback as one group every `interval` or once
+// maxBatch books are waiting, so bursts of slider and rating changes cost
+// one transaction and one sync instead of one each.
+//
+// An acknowledged update lives only in memory until its group commits, so
+// a crash can lose the last interval's worth of updates.
+//
+// An update that fails maxUpdateAttempts rounds is parked, not dropped. The
+// user's next push reports it (UpdateLost) and sends it round again, and
+// their next read reports it once; a newer update to the same book
+// replaces it.
+class WriteBehindQueue {
+public:
+    // Applies a group in one transaction; throws if it could not be
+    // committed. Updates to books that no longer exist are skipped without
+    // error. A failing group is retried, then split into one-update groups,
+    // and an update that still fails goes back in the queue.
+    using Commit = std::function<void(const std::vector<BookUpdate>& group)>;
+
+    // Some of the user's acknowledged updates are parked, unsaved.
+    class UpdateLost : public std::runtime_error {
+    public:
+        explicit UpdateLost(std::vector<int> bookIds)
+            : std::runtime_error("a book update could not be saved"), bookIds(std::move(bookIds)) {}
+        const std::vector<int> bookIds;
+    };
+
+    explicit WriteBehindQueue(Commit commit,
+                              std::chrono::milliseconds interval = std::chrono::milliseconds(5),
+                              size_t maxBatch = 512);
+    // Commits whatever is still pending; parked updates are logged and lost.
+    ~WriteBehindQueue();
+    WriteBehindQueue(const WriteBehindQueue&) = delete;
+    WriteBehindQueue& operator=(const WriteBehindQueue&) = delete;
+
+    // Queues update. If other updates of the user's are parked, queues
+    // those for another round instead and throws UpdateLost naming their
+    // books; the caller should have the client resend this one.
+    void push(BookUpdate update);
+    // Blocks until every update pushed so far for the user is committed,
+    // so the user's next read sees their own writes. Free when nothing of
+    // theirs is pending. Throws UpdateLost, once per parking, if some of
+    // their updates are parked.
+    void waitForUser(int userId);
+
+    static constexpr int groupAttempts = 3;
+    static constexpr int maxUpdateAttempts = 5;
+
+private:
+    void run();
+    // Commits group, retrying and then splitting it on failure. Returns the
+    // updates that could not be committed.
+    std::vector<BookUpdate> commitWithRetry(std::vector<BookUpdate> group);
+    static uint64_t keyOf(const BookUpdate& update);
+    // Adds update to pending under the lock; true if the committer needs
+    // waking.
+    bool enqueue(uint64_t key, BookUpdate update);
+    std::vector<int> parkedBooks(int userId) const;
+
+    Commit commit;
+    const std::chrono::milliseconds interval;
+    const size_t maxBatch;
+
+    std::mutex mutex;
+    std::condition_variable wake;         // committer: work arrived or is urgent
+    std::condition_variable committed;    // readers: a group finished
+    std::unordered_map<uint64_t, BookUpdate> pending;    // (user, book) -> latest
+    std::chrono::steady_clock::time_point firstPendingAt;
+    std::unordered_map<int, uint64_t> userSeq;    // user -> seq of their last push
+    uint64_t pushedSeq = 0;
+    uint64_t committedSeq = 0;
+    std::unordered_map<uint64_t, int> failedRounds;    // (user, book) -> rounds failed so far
+    std::unordered_map<int, int> retrying;    // user -> their updates queued for another round
+    std::unordered_map<uint64_t, BookUpdate> parked;    // (user, book) -> update given up on
+    std::unordered_set<int> unreported;       // users whose parked updates no read has reported
+
+    bool urgent = false;
+    bool stopping = false;
+    std::thread committer;
+};
@@ -0,0 +1,189 @@
+#include "analytics.h"
+#include "sql.h"
+#include <map>
+
+namespace {
+
+// Recounts, in the column order of the aggregate tables. NULL columns
+// count as '' or 0, matching how applyChange reads them.
+const char* statsRecount = R"(
+    SELECT user_id, COUNT(*),
+           SUM(COALESCE(rating, 0) > 0),
+           SUM(MAX(COALESCE(rating, 0), 0)),
+           SUM(COALESCE(pages_read, 0)),
+           SUM(COALESCE(total_pages, 0))
+    FROM books GROUP BY user_id
+)";
+const char* statusRecount = R"(
+    SELECT user_id, COALESCE(status, ''), COUNT(*)
+    FROM books GROUP BY 1, 2
+)";
+const char* genreRecount = R"(
+    SELECT user_id, genre, COUNT(*)
+    FROM books WHERE genre <> '' GROUP BY 1, 2
+)";
+
+void bumpStats(Connection& conn, int userId, int64_t books, int64_t ratedBooks,
+               int64_t ratingSum, int64_t pagesRead, int64_t totalPages) {
+    auto q = conn.prepare(R"(
+        INSERT INTO user_book_stats
+            (user_id, books, rated_books, rating_sum, pages_read, total_pages)
+        VALUES (?,?,?,?,?,?)
+        ON CONFLICT(user_id) DO UPDATE SET
+            books       = books       + excluded.books,
+            rated_books = rated_books + excluded.rated_books,
+            rating_sum  = rating_sum  + excluded.rating_sum,
+            pages_read  = pages_read  + excluded.pages_read,
+            total_pages = total_pages + excluded.total_pages
+    )");
+    sql::bind(*q, userId, books, ratedBooks, ratingSum, pagesRead, totalPages);
+    q->exec();
+}
+
+// Adds delta to one (user, name) counter, dropping it when it reaches zero.
+void bumpCounter(Connection& conn, const char* upsert, const char* prune,
+                 int userId, const std::string& name, int delta) {
+    {
+        auto q = conn.prepare(upsert);
+        sql::bind(*q, userId, name, delta);
+        q->exec();
+    }
+    if (delta < 0) {
+        auto q = conn.prepare(prune);
+        sql::bind(*q, userId, name);
+        q->exec();
+    }
+}
+
+void bumpStatus(Connection& conn, int userId, const std::string& status, int delta) {
+    bumpCounter(conn,
+        "INSERT INTO user_status_counts (user_id, status, count) VALUES (?,?,?) "
+        "ON CONFLICT(user_id, status) DO UPDATE SET count = count + excluded.count",
+        "DELETE FROM user_status_counts WHERE user_id = ? AND status = ? AND count <= 0",
+        userId, status, delta);
+}
+
+void bumpGenre(Connection& conn, int userId, const std::string& genre, int delta) {
+    // Books without a genre are not part of the histogram.
+    if (genre.empty()) return;
+    bumpCounter(conn,
+        "INSERT INTO user_genre_counts (user_id, genre, count) VALUES (?,?,?) "
+        "ON CONFLICT(user_id, genre) DO UPDATE SET count = count + excluded.count",
+        "DELETE FROM user_genre_counts WHERE user_id = ? AND genre = ? AND count <= 0",
+        userId, genre, delta);
+}
+
+// Users whose rows in table differ from the recount, in either direction.
+std::string mismatchedUsers(const std::string& table, const char* recount) {
+    std::string stored = "SELECT * FROM " + table;
+    return "SELECT user_id FROM (" + std::string(recount) + " EXCEPT " + stored + ") "
+           "UNION ALL "
+           "SELECT user_id FROM (" + stored + " EXCEPT " + recount + ")";
+}
+
+} // namespace
+
+namespace analytics {
+
+void applyChange(Connection& conn, int userId, const BookFacts* before, const BookFacts* after) {
+    auto rated = [](const BookFacts* b) { return b && b->rating > 0 ? 1 : 0; };
+    auto rating = [](const BookFacts* b) { return b && b->rating > 0 ? b->rating : 0; };
+
+    bumpStats(conn, userId,
+              (after ? 1 : 0) - (before ? 1 : 0),
+              rated(after) - rated(before),
+              rating(after) - rating(before),
+              (after ? after->pagesRead : 0) - (before ? before->pagesRead : 0),
+              (after ? after->totalPages : 0) - (before ? before->totalPages : 0));
+    if (!after) {
+        auto q = conn.prepare("DELETE FROM user_book_stats WHERE user_id = ? AND books <= 0");
+        sql::bind(*q, userId);
+        q->exec();
+    }
+
+    // Counters only move when the value changes, so a typical progress
+    // update touches the stats row alone.
+    if (!before || !after || before->status != after->status) {
+        if (before) bumpStatus(conn, userId, before->status, -1);
+        if (after)  bumpStatus(conn, userId, after->status, +1);
+    }
+    if (!before || !after || before->genre != after->genre) {
+        if (before) bumpGenre(conn, userId, before->genre, -1);
+        if (after)  bumpGenre(conn, userId, after->genre, +1);
+    }
+}
+
+void applyInserts(Connection& conn, int userId, const std::vector<BookFacts>& added) {
+    if (added.empty()) return;
+    int64_t ratedBooks = 0, ratingSum = 0, pagesRead = 0, totalPages = 0;
+    std::map<std::string, int> statuses, genres;
+    for (const BookFacts& b : added) {
+        if (b.rating > 0) {
+            ++ratedBooks;
+            ratingSum += b.rating;
+        }
+        pagesRead += b.pagesRead;
+        totalPages += b.totalPages;
+        ++statuses[b.status];
+        ++genres[b.genre];
+    }
+    bumpStats(conn, userId, static_cast<int64_t>(added.size()), ratedBooks, ratingSum, pagesRead, totalPages);
+    for (const auto& [status, n] : statuses) bumpStatus(conn, userId, status, n);
+    for (const auto& [genre, n] : genres)    bumpGenre(conn, userId, genre, n);
+}
+
+LibraryStats load(Connection& conn, int userId) {
+    LibraryStats stats;
+    {
+        auto q = conn.prepare(
+            "SELECT books, rated_books, rating_sum, pages_read, total_pages "
+            "FROM user_book_stats WHERE user_id = ?");
+        sql::bind(*q, userId);
+        if (q->executeStep()) {
+            stats.totalBooks = q->getColumn(0).getInt64();
+            stats.ratedBooks = q->getColumn(1).getInt64();
+            stats.ratingSum  = q->getColumn(2).getInt64();
+            stats.pagesRead  = q->getColumn(3).getInt64();
+            stats.totalPages = q->getColumn(4).getInt64();
+        }
+    }
+    {
+        auto q = conn.prepare(
+            "SELECT status, count FROM user_status_counts WHERE user_id = ?");
+        sql::bind(*q, userId);
+        while (q->executeStep()) {
+            stats.statusCounts.emplace_back(q->getColumn(0).getString(), q->getColumn(1).getInt64());
+        }
+    }
+    {
+        auto q = conn.prepare(
+            "SELECT genre, count FROM user_genre_counts WHERE user_id = ? "
+            "ORDER BY count DESC, genre");
+        sql::bind(*q, userId);
+        while (q->executeStep()) {
+            stats.genres.emplace_back(q->getColumn(0).getString(), q->getColumn(1).getInt64());
+        }
+    }
+    return stats;
+}
+
+int verify(SQLite::Database& db) {
+    SQLite::Statement q(db,
+        "SELECT COUNT(DISTINCT user_id) FROM (" +
+        mismatchedUsers("user_book_stats", statsRecount) + " UNION ALL " +
+        mismatchedUsers("user_status_counts", statusRecount) + " UNION ALL " +
+        mismatchedUsers("user_genre_counts", genreRecount) + ")");
+    q.executeStep();
+    return q.getColumn(0).getInt();
+}
+
+void rebuild(SQLite::Database& db) {
+    db.exec("DELETE FROM user_book_stats");
+    db.exec("DELETE FROM user_status_counts");
+    db.exec("DELETE FROM user_genre_counts");
+    db.exec(std::string("INSERT INTO user_book_stats ") + statsRecount);
+    db.exec(std::string("INSERT INTO user_status_counts ") + statusRecount);
+    db.exec(std::string("INSERT INTO user_genre_counts ") + genreRecount);
+}
+
+} // namespace analytics
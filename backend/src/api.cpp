@@ -1,26 +1,268 @@
 #include "api.h"
+#include "metrics.h"
 #include <curl/curl.h>
+#include <cctype>
 
-size_t WriteCallback(void* contents, size_t size, size_t nmemb, std::string* output) {
+namespace {
+
+// Cache key: lowercased, trimmed, internal whitespace collapsed.
+std::string normalizeQuery(const std::string& query) {
+    std::string out;
+    out.reserve(query.size());
+    bool space = false;
+    for (unsigned char c : query) {
+        if (std::isspace(c)) {
+            space = !out.empty();
+            continue;
+        }
+        if (space) out += ' ';
+        space = false;
+        out += static_cast<char>(std::tolower(c));
+    }
+    return out;
+}
+
+// Percent-encodes a query string value (RFC 3986 unreserved kept).
+std::string urlEncode(const std::string& value) {
+    static const char hex[] = "0123456789ABCDEF";
+    std::string out;
+    for (unsigned char c : value) {
+        if (std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+            out += static_cast<char>(c);
+        } else {
+            out += '%';
+            out += hex[c >> 4];
+            out += hex[c & 0xF];
+        }
+    }
+    return out;
+}
+
+} // namespace
+
+GoogleBooksAPI::GoogleBooksAPI() : GoogleBooksAPI(Options{}) {}
+
+GoogleBooksAPI::GoogleBooksAPI(Options options)
+    : options(std::move(options)),
+      cache(this->options.cacheEntries, this->options.cacheTtl) {
+    // Not thread-safe, so do it here rather than lazily in curl_easy_init.
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    multi = curl_multi_init();
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, 16L);
+    loop = std::thread([this] { run(); });
+}
+
+GoogleBooksAPI::~GoogleBooksAPI() {
+    stopping = true;
+    curl_multi_wakeup(multi);
+    loop.join();
+    for (auto& [handle, transfer] : active) {
+        curl_multi_remove_handle(multi, handle);
+        curl_easy_cleanup(handle);
+    }
+    for (CURL* handle : idleHandles) curl_easy_cleanup(handle);
+    curl_multi_cleanup(multi);
+    curl_global_cleanup();
+}
+
+namespace {
+
+metrics::Counter& searchOutcome(const char* result) {
+    return metrics::registry().counter("booktracker_google_search_total",
+        "Google Books searches by how they were answered",
+        std::string("result=\"") + result + "\"");
+}
+
+} // namespace
+
+SearchCache::Body GoogleBooksAPI::search(const std::string& query) {
+    static metrics::Histogram& timing = metrics::registry().histogram(
+        "booktracker_google_search_seconds", "Time to answer a Google Books search, cache hits included");
+    static metrics::Counter& hits       = searchOutcome("hit");
+    static metrics::Counter& fetched    = searchOutcome("fetched");
+    static metrics::Counter& coalesced  = searchOutcome("coalesced");
+    static metrics::Counter& overloaded = searchOutcome("overloaded");
+    static metrics::Counter& timedOut   = searchOutcome("timeout");
+    static metrics::Counter& failed     = searchOutcome("error");
+    metrics::Timer timer(timing);
+
+    std::string key = normalizeQuery(query);
+    if (auto body = cache.get(key)) {
+        hits.add();
+        return body;
+    }
+
+    // Bound the number of server threads parked on upstream at any time.
+    if (waiting.fetch_add(1) >= options.maxWaiting) {
+        waiting.fetch_sub(1);
+        overloaded.add();
+        throw SearchOverloaded("Too many searches in progress");
+    }
+    struct WaitingGuard {
+        std::atomic<int>& n;
+        ~WaitingGuard() { n.fetch_sub(1); }
+    } guard{waiting};
+
+    // Single flight: the first caller submits, the rest share its future.
+    std::shared_future<SearchCache::Body> result;
+    {
+        std::lock_guard<std::mutex> lock(inflightMutex);
+        auto it = inflight.find(key);
+        if (it != inflight.end()) {
+            result = it->second;
+            coalesced.add();
+        } else {
+            auto promise = std::make_shared<std::promise<SearchCache::Body>>();
+            result = promise->get_future().share();
+            inflight.emplace(key, result);
+            fetched.add();
+
+            auto transfer = std::make_unique<Transfer>();
+            transfer->url = options.baseUrl + "?q=" + urlEncode(key);
+            // Runs on the event thread.
+            transfer->onDone = [this, key, promise](Transfer& done, int curlCode, long status) {
+                if (curlCode != CURLE_OK) {
+                    promise->set_exception(std::make_exception_ptr(std::runtime_error(
+                        std::string("Google Books request failed: ") +
+                        curl_easy_strerror(static_cast<CURLcode>(curlCode)))));
+                } else if (status != 200) {
+                    promise->set_exception(std::make_exception_ptr(std::runtime_error(
+                        "Google Books returned HTTP " + std::to_string(status))));
+                } else {
+                    auto body = std::make_shared<const std::string>(std::move(done.body));
+                    cache.put(key, body);
+                    promise->set_value(std::move(body));
+                }
+                std::lock_guard<std::mutex> lock(inflightMutex);
+                inflight.erase(key);
+            };
+            submit(std::move(transfer));
+        }
+    }
+
+    // A late upstream answer still lands in the cache for the next caller.
+    if (result.wait_for(options.deadline) != std::future_status::ready) {
+        timedOut.add();
+        throw SearchTimeout("Google Books did not answer in time");
+    }
+    try {
+        return result.get();
+    } catch (...) {
+        failed.add();
+        throw;
+    }
+}
+
+GoogleBooksAPI::Download GoogleBooksAPI::fetch(const std::string& url, size_t maxBytes,
+                                                std::chrono::milliseconds deadline) {
+    auto promise = std::make_shared<std::promise<Download>>();
+    auto result = promise->get_future();
+
+    auto transfer = std::make_unique<Transfer>();
+    transfer->url = url;
+    transfer->maxBytes = maxBytes;
+    // Runs on the event thread.
+    transfer->onDone = [promise, url, maxBytes](Transfer& done, int curlCode, long status) {
+        if (curlCode == CURLE_WRITE_ERROR) {
+            promise->set_exception(std::make_exception_ptr(std::runtime_error(
+                "Fetching " + url + " failed: body larger than " + std::to_string(maxBytes) + " bytes")));
+        } else if (curlCode != CURLE_OK) {
+            promise->set_exception(std::make_exception_ptr(std::runtime_error(
+                "Fetching " + url + " failed: " + curl_easy_strerror(static_cast<CURLcode>(curlCode)))));
+        } else if (status != 200) {
+            promise->set_exception(std::make_exception_ptr(std::runtime_error(
+                "Fetching " + url + " returned HTTP " + std::to_string(status))));
+        } else {
+            promise->set_value(Download{std::move(done.body), std::move(done.contentType)});
+        }
+    };
+    submit(std::move(transfer));
+
+    if (result.wait_for(deadline) != std::future_status::ready) {
+        throw SearchTimeout("Fetching " + url + " took too long");
+    }
+    return result.get();
+}
+
+void GoogleBooksAPI::submit(std::unique_ptr<Transfer> transfer) {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        queued.push_back(std::move(transfer));
+    }
+    curl_multi_wakeup(multi);
+}
+
+void GoogleBooksAPI::run() {
+    while (!stopping) {
+        std::vector<std::unique_ptr<Transfer>> batch;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            batch.swap(queued);
+        }
+        for (auto& transfer : batch) start(std::move(transfer));
+
+        int running = 0;
+        curl_multi_perform(multi, &running);
+
+        int remaining = 0;
+        while (CURLMsg* msg = curl_multi_info_read(multi, &remaining)) {
+            if (msg->msg == CURLMSG_DONE) finish(msg->easy_handle, msg->data.result);
+        }
+
+        // Sleeps until a socket is ready, a timer fires, or submit() wakes us.
+        curl_multi_poll(multi, nullptr, 0, 1000, nullptr);
+    }
+}
+
+void GoogleBooksAPI::start(std::unique_ptr<Transfer> transfer) {
+    CURL* curl;
+    if (!idleHandles.empty()) {
+        // Reused handles keep their DNS cache; the multi handle keeps the
+        // keep-alive connections.
+        curl = idleHandles.back();
+        idleHandles.pop_back();
+    } else {
+        curl = curl_easy_init();
+    }
+    if (!curl) {
+        transfer->onDone(*transfer, CURLE_FAILED_INIT, 0);
+        return;
+    }
+    curl_easy_setopt(curl, CURLOPT_URL, transfer->url.c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, onBody);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, transfer.get());
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, 5000L);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, 15000L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+
+    transfer->handle = curl;
+    curl_multi_add_handle(multi, curl);
+    active.emplace(curl, std::move(transfer));
+}
+
+size_t GoogleBooksAPI::onBody(void* contents, size_t size, size_t nmemb, void* userdata) {
+    auto* transfer = static_cast<Transfer*>(userdata);
     size_t total = size * nmemb;
-    output->append((char*)contents, total);
+    // Returning short fails the transfer with CURLE_WRITE_ERROR.
+    if (transfer->maxBytes && transfer->body.size() + total > transfer->maxBytes) return 0;
+    transfer->body.append(static_cast<char*>(contents), total);
     return total;
 }
 
-nlohmann::json GoogleBooksAPI::search(const std::string& query) {
-    CURL* curl = curl_easy_init();
-    std::string readBuffer;
+void GoogleBooksAPI::finish(CURL* handle, int curlCode) {
+    long status = 0;
+    curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &status);
+    char* contentType = nullptr;
+    curl_easy_getinfo(handle, CURLINFO_CONTENT_TYPE, &contentType);
+    curl_multi_remove_handle(multi, handle);
 
-    if (curl) {
-        char* escapedQuery = curl_easy_escape(curl, query.c_str(), query.size());
-        std::string url = "https://www.googleapis.com/books/v1/volumes?q=" + std::string(escapedQuery);
-        curl_free(escapedQuery);
+    auto it = active.find(handle);
+    std::unique_ptr<Transfer> transfer = std::move(it->second);
+    active.erase(it);
+    idleHandles.push_back(handle);
+    if (contentType) transfer->contentType = contentType;
 
-        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
-        curl_easy_perform(curl);
-        curl_easy_cleanup(curl);
-    }
-    return nlohmann::json::parse(readBuffer);
+    transfer->onDone(*transfer, curlCode, status);
 }
@@ -0,0 +1,253 @@
+#include "book_import.h"
+#include "book_input.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+
+namespace {
+
+enum Field { Title, Author, Genre, Status, PagesRead, TotalPages, Notes, Tags, GoalEndDate, Thumbnail, Rating };
+
+// Column names as in the JSON API; CSV headers are matched after dropping
+// case, '_' and spaces.
+const char* const fieldNames[] = {
+    "title", "author", "genre", "status", "pagesRead", "totalPages",
+    "notes", "tags", "goalEndDate", "thumbnail", "rating"
+};
+
+std::string foldName(const std::string& name) {
+    std::string out;
+    for (unsigned char c : name) {
+        if (c == '_' || c == ' ') continue;
+        out += static_cast<char>(std::tolower(c));
+    }
+    return out;
+}
+
+int fieldIndex(const std::string& header) {
+    std::string folded = foldName(header);
+    for (int i = 0; i <= Rating; ++i) {
+        if (folded == foldName(fieldNames[i])) return i;
+    }
+    return -1;
+}
+
+// Empty text leaves the default in place.
+bool parseInt(const std::string& text, int& out) {
+    if (text.empty()) return true;
+    const char* end = text.data() + text.size();
+    auto [ptr, ec] = std::from_chars(text.data(), end, out);
+    return ec == std::errc() && ptr == end;
+}
+
+// Returns an error message, or "" if the book is acceptable.
+std::string validate(const NewBook& b) {
+    BookInput view;
+    view.title = b.title;
+    view.status = b.status;
+    view.pagesRead = b.pagesRead;
+    view.totalPages = b.totalPages;
+    view.rating = b.rating;
+    const char* problem = checkBook(view, true);
+    return problem ? problem : "";
+}
+
+} // namespace
+
+BookImporter::BookImporter(Format format, Flush flush, size_t batchSize)
+    : format(format), flush(std::move(flush)), batchSize(batchSize) {
+    batch.reserve(batchSize);
+}
+
+void BookImporter::feed(const char* data, size_t size) {
+    if (format == Format::Csv) {
+        feedCsv(data, size);
+        return;
+    }
+    for (const char* p = data, *end = data + size; p < end; ) {
+        const char* nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        const char* stop = nl ? nl : end;
+        if (!overlong) {
+            if (line.size() + (stop - p) > maxRowBytes) {
+                overlong = true;
+                line.clear();
+            } else {
+                line.append(p, stop);
+            }
+        }
+        if (!nl) break;
+        endJsonLine();
+        p = nl + 1;
+    }
+}
+
+void BookImporter::finish() {
+    if (format == Format::Csv) {
+        if (inQuotes) {
+            reject("unterminated quoted field");
+        } else if (!field.empty() || !record.empty()) {
+            endCsvField();
+            endCsvRecord();
+        }
+    } else if (!line.empty() || overlong) {
+        endJsonLine();
+    }
+    flushBatch();
+}
+
+void BookImporter::feedCsv(const char* data, size_t size) {
+    // RFC 4180: fields may be quoted, quotes inside are doubled, and quoted
+    // fields may span lines.
+    for (size_t i = 0; i < size; ++i) {
+        char c = data[i];
+        if (++rowBytes > maxRowBytes && !overlong) {
+            overlong = true;
+            field.clear();
+            record.clear();
+        }
+        if (inQuotes) {
+            if (c == '"') {
+                inQuotes = false;
+                afterQuote = true;
+            } else if (!overlong) {
+                field += c;
+            }
+            continue;
+        }
+        if (afterQuote) {
+            afterQuote = false;
+            if (c == '"') {
+                // Doubled quote inside a quoted field
+                if (!overlong) field += '"';
+                inQuotes = true;
+                continue;
+            }
+        }
+        switch (c) {
+            case '"':
+                if (field.empty()) inQuotes = true;
+                else if (!overlong) field += c;
+                break;
+            case ',':
+                if (!overlong) endCsvField();
+                break;
+            case '\r':
+                break;
+            case '\n':
+                if (!overlong) endCsvField();
+                endCsvRecord();
+                break;
+            default:
+                if (!overlong) field += c;
+        }
+    }
+}
+
+void BookImporter::endCsvField() {
+    record.push_back(std::move(field));
+    field.clear();
+}
+
+void BookImporter::endCsvRecord() {
+    if (overlong) {
+        reject("row is too long");
+    } else if (record.size() == 1 && record[0].empty()) {
+        // Blank line
+        ++row;
+    } else if (!haveHeader) {
+        haveHeader = true;
+        for (const std::string& name : record) columns.push_back(fieldIndex(name));
+        badHeader = std::find(columns.begin(), columns.end(), Title) == columns.end();
+        if (badHeader) reject("header must include a title column");
+        else ++row;
+    } else if (badHeader) {
+        reject("no usable header");
+    } else {
+        NewBook book;
+        std::string error;
+        for (size_t i = 0; i < record.size() && i < columns.size() && error.empty(); ++i) {
+            std::string& value = record[i];
+            switch (columns[i]) {
+                case Title:       book.title = std::move(value); break;
+                case Author:      book.author = std::move(value); break;
+                case Genre:       book.genre = std::move(value); break;
+                case Status:      if (!value.empty()) book.status = std::move(value); break;
+                case PagesRead:   if (!parseInt(value, book.pagesRead))  error = "pagesRead must be an integer"; break;
+                case TotalPages:  if (!parseInt(value, book.totalPages)) error = "totalPages must be an integer"; break;
+                case Notes:       book.notes = std::move(value); break;
+                case Tags:        book.tags = std::move(value); break;
+                case GoalEndDate: book.goalEndDate = std::move(value); break;
+                case Thumbnail:   book.thumbnail = std::move(value); break;
+                case Rating:      if (!parseInt(value, book.rating)) error = "rating must be an integer"; break;
+                default:          break;
+            }
+        }
+        if (error.empty()) error = validate(book);
+        if (error.empty()) accept(std::move(book));
+        else reject(std::move(error));
+    }
+    record.clear();
+    rowBytes = 0;
+    overlong = false;
+}
+
+void BookImporter::endJsonLine() {
+    if (overlong) {
+        reject("row is too long");
+        overlong = false;
+        line.clear();
+        return;
+    }
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (line.find_first_not_of(" \t") == std::string::npos) {
+        ++row;
+        line.clear();
+        return;
+    }
+
+    // input views line, so it is copied out before the line is reused
+    BookInputParser parser;
+    BookInput input;
+    std::string error;
+    if (!parser.parse(line, input)) error = parser.error();
+    else if (const char* problem = checkBook(input, true)) error = problem;
+    NewBook book;
+    if (error.empty()) {
+        book.title = input.title;
+        book.author = input.author;
+        book.genre = input.genre;
+        book.status = input.status;
+        book.pagesRead = input.pagesRead;
+        book.totalPages = input.totalPages;
+        book.notes = input.notes;
+        book.tags = input.tags;
+        book.goalEndDate = input.goalEndDate;
+        book.thumbnail = input.thumbnail;
+        book.rating = input.rating;
+    }
+    line.clear();
+    if (error.empty()) accept(std::move(book));
+    else reject(std::move(error));
+}
+
+void BookImporter::accept(NewBook&& book) {
+    ++row;
+    batch.push_back(std::move(book));
+    if (batch.size() >= batchSize) flushBatch();
+}
+
+void BookImporter::reject(std::string message) {
+    ++failedCount;
+    if (rowErrors.size() < maxReportedErrors) {
+        rowErrors.push_back(RowError{row, std::move(message)});
+    }
+    ++row;
+}
+
+void BookImporter::flushBatch() {
+    if (batch.empty()) return;
+    flush(batch);
+    importedCount += batch.size();
+    batch.clear();
+}
@@ -0,0 +1,379 @@
+#include "book_input.h"
+#include <charconv>
+#include <cstring>
+
+namespace {
+
+constexpr int maxDepth = 64;    // nesting allowed in skipped values
+
+struct TextField {
+    const char* name;
+    std::string_view BookInput::*member;
+};
+
+struct IntField {
+    const char* name;
+    int BookInput::*member;
+};
+
+const TextField textFields[] = {
+    {"title", &BookInput::title},
+    {"author", &BookInput::author},
+    {"genre", &BookInput::genre},
+    {"status", &BookInput::status},
+    {"notes", &BookInput::notes},
+    {"tags", &BookInput::tags},
+    {"goalEndDate", &BookInput::goalEndDate},
+    {"thumbnail", &BookInput::thumbnail},
+};
+
+const IntField intFields[] = {
+    {"pagesRead", &BookInput::pagesRead},
+    {"totalPages", &BookInput::totalPages},
+    {"rating", &BookInput::rating},
+};
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// The 4 hex digits at s, or -1
+int hex4(const char* s) {
+    int value = 0;
+    for (int i = 0; i < 4; ++i) {
+        int digit = hexValue(s[i]);
+        if (digit < 0) return -1;
+        value = value * 16 + digit;
+    }
+    return value;
+}
+
+// Length of the well-formed UTF-8 sequence at s (lead byte >= 0x80), or 0
+// for overlong forms, surrogates, code points past U+10FFFF and
+// truncated sequences.
+size_t utf8Length(const unsigned char* s, const unsigned char* end) {
+    size_t length;
+    unsigned char min = 0x80, max = 0xBF;    // bounds on the second byte
+    if (s[0] >= 0xC2 && s[0] <= 0xDF)      length = 2;
+    else if (s[0] >= 0xE0 && s[0] <= 0xEF) {
+        length = 3;
+        if (s[0] == 0xE0) min = 0xA0;
+        if (s[0] == 0xED) max = 0x9F;
+    } else if (s[0] >= 0xF0 && s[0] <= 0xF4) {
+        length = 4;
+        if (s[0] == 0xF0) min = 0x90;
+        if (s[0] == 0xF4) max = 0x8F;
+    } else {
+        return 0;
+    }
+    if (static_cast<size_t>(end - s) < length) return 0;
+    if (s[1] < min || s[1] > max) return 0;
+    for (size_t i = 2; i < length; ++i) {
+        if (s[i] < 0x80 || s[i] > 0xBF) return 0;
+    }
+    return length;
+}
+
+// Finds the closing quote of the string whose body starts at p, checking
+// escapes, control characters and UTF-8 on the way. Returns nullptr if the
+// string is malformed or unterminated.
+const char* scanString(const char* p, const char* end, bool& escaped) {
+    escaped = false;
+    while (p < end) {
+        unsigned char c = static_cast<unsigned char>(*p);
+        if (c == '"') return p;
+        if (c < 0x20) return nullptr;
+        if (c == '\\') {
+            escaped = true;
+            if (end - p < 2) return nullptr;
+            char e = p[1];
+            if (e == 'u') {
+                if (end - p < 6 || hex4(p + 2) < 0) return nullptr;
+                p += 6;
+            } else if (e != '\0' && std::strchr("\"\\/bfnrt", e)) {
+                p += 2;
+            } else {
+                return nullptr;
+            }
+        } else if (c < 0x80) {
+            ++p;
+        } else {
+            size_t length = utf8Length(reinterpret_cast<const unsigned char*>(p),
+                                       reinterpret_cast<const unsigned char*>(end));
+            if (length == 0) return nullptr;
+            p += length;
+        }
+    }
+    return nullptr;
+}
+
+char* putUtf8(char* out, unsigned codePoint) {
+    if (codePoint < 0x80) {
+        *out++ = static_cast<char>(codePoint);
+    } else if (codePoint < 0x800) {
+        *out++ = static_cast<char>(0xC0 | (codePoint >> 6));
+        *out++ = static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else if (codePoint < 0x10000) {
+        *out++ = static_cast<char>(0xE0 | (codePoint >> 12));
+        *out++ = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        *out++ = static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else {
+        *out++ = static_cast<char>(0xF0 | (codePoint >> 18));
+        *out++ = static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+        *out++ = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        *out++ = static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+    return out;
+}
+
+// Decodes the escapes in [p, close), already checked by scanString, into
+// out. Returns the end of the output, or nullptr for an unpaired
+// surrogate. Never writes more bytes than it reads.
+char* unescape(const char* p, const char* close, char* out) {
+    while (p < close) {
+        if (*p != '\\') {
+            *out++ = *p++;
+            continue;
+        }
+        char e = p[1];
+        p += 2;
+        switch (e) {
+        case 'b': *out++ = '\b'; break;
+        case 'f': *out++ = '\f'; break;
+        case 'n': *out++ = '\n'; break;
+        case 'r': *out++ = '\r'; break;
+        case 't': *out++ = '\t'; break;
+        case 'u': {
+            unsigned codePoint = static_cast<unsigned>(hex4(p));
+            p += 4;
+            if (codePoint >= 0xDC00 && codePoint <= 0xDFFF) return nullptr;
+            if (codePoint >= 0xD800 && codePoint <= 0xDBFF) {
+                if (close - p < 6 || p[0] != '\\' || p[1] != 'u') return nullptr;
+                int low = hex4(p + 2);
+                if (low < 0xDC00 || low > 0xDFFF) return nullptr;
+                codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                p += 6;
+            }
+            out = putUtf8(out, codePoint);
+            break;
+        }
+        default: *out++ = e; break;    // " \ /
+        }
+    }
+    return out;
+}
+
+// Finds the end of the JSON number at p; integral is false if it has a
+// fraction or exponent. Returns nullptr if it is malformed.
+const char* scanNumber(const char* p, const char* end, bool& integral) {
+    auto digits = [&] {
+        const char* start = p;
+        while (p < end && *p >= '0' && *p <= '9') ++p;
+        return p > start;
+    };
+    integral = true;
+    if (p < end && *p == '-') ++p;
+    if (p < end && *p == '0') ++p;
+    else if (!digits()) return nullptr;
+    if (p < end && *p == '.') {
+        ++p;
+        integral = false;
+        if (!digits()) return nullptr;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        integral = false;
+        if (p < end && (*p == '+' || *p == '-')) ++p;
+        if (!digits()) return nullptr;
+    }
+    return p;
+}
+
+bool isStatus(std::string_view s) {
+    return s == "Not Started" || s == "Reading" || s == "Completed";
+}
+
+} // namespace
+
+const char* checkBook(const BookInput& book, bool requireTitle) {
+    if (requireTitle && book.title.empty()) return "title is required";
+    if (!isStatus(book.status)) return "status must be Not Started, Reading or Completed";
+    if (book.pagesRead < 0 || book.totalPages < 0) return "page counts must not be negative";
+    if (book.rating < 0 || book.rating > 5) return "rating must be between 0 and 5";
+    return nullptr;
+}
+
+char* BookInputParser::Arena::allocate(size_t size) {
+    if (size <= sizeof(buffer) - used) {
+        char* out = buffer + used;
+        used += size;
+        return out;
+    }
+    blocks.emplace_back(new char[size]);
+    return blocks.back().get();
+}
+
+bool BookInputParser::parse(std::string_view body, BookInput& out) {
+    p = body.data();
+    end = p + body.size();
+    problem.clear();
+
+    skipSpace();
+    if (p == end || *p != '{') return fail("body must be a JSON object");
+    ++p;
+    skipSpace();
+    if (p < end && *p == '}') {
+        ++p;
+    } else {
+        for (;;) {
+            if (p == end || *p != '"') return fail("invalid JSON: expected a field name");
+            std::string_view key;
+            if (!parseString(key)) return false;
+            skipSpace();
+            if (p == end || *p != ':') return fail("invalid JSON: expected ':'");
+            ++p;
+            skipSpace();
+            if (!parseField(key, out)) return false;
+            skipSpace();
+            if (p < end && *p == ',') {
+                ++p;
+                skipSpace();
+                continue;
+            }
+            if (p < end && *p == '}') {
+                ++p;
+                break;
+            }
+            return fail("invalid JSON: expected ',' or '}'");
+        }
+    }
+    skipSpace();
+    if (p != end) return fail("invalid JSON: unexpected data after the object");
+    return true;
+}
+
+bool BookInputParser::fail(std::string message) {
+    problem = std::move(message);
+    return false;
+}
+
+void BookInputParser::skipSpace() {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) ++p;
+}
+
+// At the opening quote
+bool BookInputParser::parseString(std::string_view& out) {
+    bool escaped;
+    const char* close = scanString(p + 1, end, escaped);
+    if (!close) return fail("invalid JSON string");
+    if (!escaped) {
+        out = std::string_view(p + 1, close - (p + 1));
+    } else {
+        char* text = arena.allocate(close - (p + 1));
+        char* textEnd = unescape(p + 1, close, text);
+        if (!textEnd) return fail("invalid JSON string: unpaired surrogate");
+        out = std::string_view(text, textEnd - text);
+    }
+    p = close + 1;
+    return true;
+}
+
+bool BookInputParser::parseInt(std::string_view key, int& out) {
+    bool integral;
+    const char* numberEnd = scanNumber(p, end, integral);
+    if (!numberEnd || !integral) return fail(std::string(key) + " must be an integer");
+    auto [ptr, ec] = std::from_chars(p, numberEnd, out);
+    if (ec != std::errc() || ptr != numberEnd) return fail(std::string(key) + " is out of range");
+    p = numberEnd;
+    return true;
+}
+
+bool BookInputParser::skipValue(int depth) {
+    if (depth > maxDepth) return fail("invalid JSON: nested too deeply");
+    if (p == end) return fail("invalid JSON: expected a value");
+    auto literal = [&](std::string_view word) {
+        if (static_cast<size_t>(end - p) < word.size() || std::string_view(p, word.size()) != word) {
+            return fail("invalid JSON value");
+        }
+        p += word.size();
+        return true;
+    };
+    switch (*p) {
+    case '"': {
+        bool escaped;
+        const char* close = scanString(p + 1, end, escaped);
+        if (!close) return fail("invalid JSON string");
+        p = close + 1;
+        return true;
+    }
+    case '{':
+    case '[': {
+        char closing = *p == '{' ? '}' : ']';
+        ++p;
+        skipSpace();
+        if (p < end && *p == closing) {
+            ++p;
+            return true;
+        }
+        for (;;) {
+            if (closing == '}') {
+                if (p == end || *p != '"') return fail("invalid JSON: expected a field name");
+                if (!skipValue(depth + 1)) return false;
+                skipSpace();
+                if (p == end || *p != ':') return fail("invalid JSON: expected ':'");
+                ++p;
+                skipSpace();
+            }
+            if (!skipValue(depth + 1)) return false;
+            skipSpace();
+            if (p < end && *p == ',') {
+                ++p;
+                skipSpace();
+                continue;
+            }
+            if (p < end && *p == closing) {
+                ++p;
+                return true;
+            }
+            return fail(std::string("invalid JSON: expected ',' or '") + closing + "'");
+        }
+    }
+    case 't': return literal("true");
+    case 'f': return literal("false");
+    case 'n': return literal("null");
+    default: {
+        bool integral;
+        const char* numberEnd = scanNumber(p, end, integral);
+        if (!numberEnd) return fail("invalid JSON value");
+        p = numberEnd;
+        return true;
+    }
+    }
+}
+
+bool BookInputParser::parseField(std::string_view key, BookInput& out) {
+    bool isNull = static_cast<size_t>(end - p) >= 4 && std::string_view(p, 4) == "null";
+    for (const TextField& field : textFields) {
+        if (key != field.name) continue;
+        if (isNull) {
+            p += 4;
+            return true;
+        }
+        if (p == end || *p != '"') return fail(std::string(key) + " must be a string");
+        if (!parseString(out.*field.member)) return false;
+        if ((out.*field.member).size() > maxTextBytes) return fail(std::string(key) + " is too long");
+        return true;
+    }
+    for (const IntField& field : intFields) {
+        if (key != field.name) continue;
+        if (isNull) {
+            p += 4;
+            return true;
+        }
+        return parseInt(key, out.*field.member);
+    }
+    return skipValue(0);
+}
@@ -0,0 +1,152 @@
+#include "compression.h"
+#include <zlib.h>
+#ifdef BOOKTRACKER_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include <cctype>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+// Fast levels: responses are compressed once per request, not once per
+// deploy like the static assets.
+constexpr int gzipLevel = 4;
+constexpr int zstdLevel = 3;
+
+} // namespace
+
+AcceptEncoding::AcceptEncoding(const std::string& header) {
+    std::istringstream ss(header);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        std::string coding;
+        double q = 1;
+        size_t semi = item.find(';');
+        for (char c : item.substr(0, semi)) {
+            if (!std::isspace(static_cast<unsigned char>(c))) coding += std::tolower(static_cast<unsigned char>(c));
+        }
+        if (coding.empty()) continue;
+        if (semi != std::string::npos) {
+            size_t eq = item.find("q=", semi);
+            if (eq != std::string::npos) q = std::atof(item.c_str() + eq + 2);
+        }
+        if (coding == "x-gzip") coding = "gzip";
+        if (coding == "*") any = q;
+        else               codings.emplace_back(std::move(coding), q);
+    }
+}
+
+bool AcceptEncoding::accepts(const std::string& coding) const {
+    for (const auto& [name, q] : codings) {
+        if (name == coding) return q > 0;
+    }
+    return any > 0;
+}
+
+Coding negotiateCoding(const std::string& acceptEncoding) {
+    // As for static assets: zstd beats gzip where both are accepted.
+    AcceptEncoding accepted(acceptEncoding);
+#ifdef BOOKTRACKER_HAVE_ZSTD
+    if (accepted.accepts("zstd")) return Coding::Zstd;
+#endif
+    if (accepted.accepts("gzip")) return Coding::Gzip;
+    return Coding::Identity;
+}
+
+const char* codingName(Coding coding) {
+    switch (coding) {
+    case Coding::Gzip: return "gzip";
+    case Coding::Zstd: return "zstd";
+    default:           return "identity";
+    }
+}
+
+Compressor::Compressor(Coding coding) : coding(coding) {
+    if (coding == Coding::Gzip) {
+        zlib = new z_stream{};
+        // 15 window bits + 16 selects the gzip wrapper
+        if (deflateInit2(zlib, gzipLevel, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            delete zlib;
+            throw std::runtime_error("deflateInit2 failed");
+        }
+    }
+#ifdef BOOKTRACKER_HAVE_ZSTD
+    if (coding == Coding::Zstd) {
+        zstd = ZSTD_createCCtx();
+        if (!zstd) throw std::runtime_error("ZSTD_createCCtx failed");
+        ZSTD_CCtx_setParameter(zstd, ZSTD_c_compressionLevel, zstdLevel);
+    }
+#endif
+}
+
+Compressor::~Compressor() {
+    if (zlib) {
+        deflateEnd(zlib);
+        delete zlib;
+    }
+#ifdef BOOKTRACKER_HAVE_ZSTD
+    if (zstd) ZSTD_freeCCtx(zstd);
+#endif
+}
+
+Compressor& Compressor::local(Coding coding) {
+    thread_local Compressor gzip(Coding::Gzip);
+#ifdef BOOKTRACKER_HAVE_ZSTD
+    thread_local Compressor zstd(Coding::Zstd);
+    if (coding == Coding::Zstd) return zstd;
+#endif
+    (void)coding;
+    return gzip;
+}
+
+void Compressor::reset() {
+    if (zlib) deflateReset(zlib);
+#ifdef BOOKTRACKER_HAVE_ZSTD
+    if (zstd) ZSTD_CCtx_reset(zstd, ZSTD_reset_session_only);
+#endif
+}
+
+bool Compressor::write(const char* data, size_t size, bool finish, const Sink& out) {
+    if (zlib) {
+        zlib->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        zlib->avail_in = static_cast<uInt>(size);
+        int rc;
+        do {
+            zlib->next_out = reinterpret_cast<Bytef*>(buffer.data());
+            zlib->avail_out = static_cast<uInt>(buffer.size());
+            rc = deflate(zlib, finish ? Z_FINISH : Z_NO_FLUSH);
+            if (rc == Z_STREAM_ERROR) return false;
+            size_t produced = buffer.size() - zlib->avail_out;
+            if (produced > 0 && !out(buffer.data(), produced)) return false;
+            // Output filling the whole buffer means more may be pending
+        } while (zlib->avail_out == 0 || (finish && rc != Z_STREAM_END));
+        return true;
+    }
+#ifdef BOOKTRACKER_HAVE_ZSTD
+    if (zstd) {
+        ZSTD_inBuffer in{data, size, 0};
+        size_t remaining;
+        do {
+            ZSTD_outBuffer chunk{buffer.data(), buffer.size(), 0};
+            remaining = ZSTD_compressStream2(zstd, &chunk, &in, finish ? ZSTD_e_end : ZSTD_e_continue);
+            if (ZSTD_isError(remaining)) return false;
+            if (chunk.pos > 0 && !out(buffer.data(), chunk.pos)) return false;
+        } while (finish ? remaining != 0 : in.pos < in.size);
+        return true;
+    }
+#endif
+    return false;
+}
+
+bool Compressor::compress(std::string& body, std::string& out) {
+    reset();
+    out.clear();
+    bool ok = write(body.data(), body.size(), true, [&out](const char* data, size_t size) {
+        out.append(data, size);
+        return true;
+    });
+    if (ok) body.swap(out);
+    return ok;
+}
@@ -0,0 +1,116 @@
+#include "connection_pool.h"
+#include "metrics.h"
+#include <sqlite3.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace {
+
+// Stands in for busy_timeout = 5000 with the same backoff schedule, so
+// every retry on a locked database can be counted.
+int onBusy(void*, int attempt) {
+    static metrics::Counter& retries = metrics::registry().counter(
+        "booktracker_sqlite_busy_retries_total", "Times a statement waited on a locked database");
+    static const int delays[] = {1, 2, 5, 10, 15, 20, 25, 25, 25, 50, 50, 100};
+    constexpr int count = sizeof delays / sizeof delays[0];
+    constexpr int timeoutMs = 5000;
+
+    int delay, waited;
+    if (attempt < count) {
+        delay = delays[attempt];
+        waited = 0;
+        for (int i = 0; i < attempt; ++i) waited += delays[i];
+    } else {
+        delay = delays[count - 1];
+        waited = 328 + delay * (attempt - count);   // 328 = sum of delays
+    }
+    if (waited >= timeoutMs) return 0;
+    retries.add();
+    std::this_thread::sleep_for(std::chrono::milliseconds(std::min(delay, timeoutMs - waited)));
+    return 1;
+}
+
+// Shared tuning for every connection. NORMAL is durable across application
+// crashes in WAL mode and only risks the last commits on power loss.
+void applyPragmas(Connection& conn) {
+    sqlite3_busy_handler(conn.getHandle(), onBusy, nullptr);
+    conn.exec("PRAGMA synchronous = NORMAL");
+    conn.exec("PRAGMA mmap_size = 268435456");
+    conn.exec("PRAGMA temp_store = MEMORY");
+}
+
+} // namespace
+
+Connection::Connection(const std::string& dbPath, int flags)
+    : SQLite::Database(dbPath, flags) {}
+
+StatementRef Connection::prepare(std::string_view query) {
+    auto it = statements.find(query);
+    if (it != statements.end()) return StatementRef(*it->second);
+    auto stmt = std::make_unique<SQLite::Statement>(*this, std::string(query));
+    SQLite::Statement& ref = *stmt;
+    statements.emplace(std::string_view(ref.getQuery()), std::move(stmt));
+    return StatementRef(ref);
+}
+
+ConnectionPool::Lease::Lease(ConnectionPool* pool, Connection* conn)
+    : pool(pool), conn(conn) {}
+
+ConnectionPool::Lease::Lease(Connection* conn, std::unique_lock<std::mutex> lock)
+    : conn(conn), writeLock(std::move(lock)) {}
+
+ConnectionPool::Lease::Lease(Lease&& other) noexcept
+    : pool(other.pool), conn(other.conn), writeLock(std::move(other.writeLock)) {
+    other.pool = nullptr;
+    other.conn = nullptr;
+}
+
+ConnectionPool::Lease::~Lease() {
+    if (pool && conn) pool->release(conn);
+}
+
+ConnectionPool::ConnectionPool(const std::string& dbPath, size_t readerCount) {
+    // The writer creates the file, so it must be opened before any reader.
+    writeConn = std::make_unique<Connection>(
+        dbPath, SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE | SQLite::OPEN_NOMUTEX);
+    writeConn->exec("PRAGMA journal_mode = WAL");
+    applyPragmas(*writeConn);
+
+    if (readerCount == 0) {
+        readerCount = std::max(2u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < readerCount; ++i) {
+        auto conn = std::make_unique<Connection>(
+            dbPath, SQLite::OPEN_READONLY | SQLite::OPEN_NOMUTEX);
+        applyPragmas(*conn);
+        idleReaders.push_back(conn.get());
+        readConns.push_back(std::move(conn));
+    }
+}
+
+ConnectionPool::Lease ConnectionPool::reader() {
+    static metrics::Counter& timeouts = metrics::registry().counter(
+        "booktracker_db_reader_timeouts_total", "Times no read-only connection came free in time");
+    std::unique_lock<std::mutex> lock(readMutex);
+    if (!readAvailable.wait_for(lock, readerTimeout, [&] { return !idleReaders.empty(); })) {
+        timeouts.add();
+        throw Busy("no database connection free");
+    }
+    Connection* conn = idleReaders.back();
+    idleReaders.pop_back();
+    return Lease(this, conn);
+}
+
+ConnectionPool::Lease ConnectionPool::writer() {
+    std::unique_lock<std::mutex> lock(writeMutex);
+    return Lease(writeConn.get(), std::move(lock));
+}
+
+void ConnectionPool::release(Connection* conn) {
+    {
+        std::lock_guard<std::mutex> lock(readMutex);
+        idleReaders.push_back(conn);
+    }
+    readAvailable.notify_one();
+}
@@ -0,0 +1,242 @@
+#include "cover_store.h"
+#include <openssl/sha.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Image type from the leading bytes; null for anything else. Upstream
+// Content-Type headers are not trusted.
+const char* sniffImage(const char* data, size_t size) {
+    auto starts = [&](const char* magic, size_t n, size_t at = 0) {
+        return size >= at + n && std::equal(magic, magic + n, data + at);
+    };
+    if (starts("\xFF\xD8\xFF", 3))                        return "image/jpeg";
+    if (starts("\x89PNG\r\n\x1A\n", 8))                   return "image/png";
+    if (starts("GIF87a", 6) || starts("GIF89a", 6))       return "image/gif";
+    if (starts("RIFF", 4) && starts("WEBP", 4, 8))        return "image/webp";
+    return nullptr;
+}
+
+std::string sha256Hex(const std::string& data) {
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    SHA256(reinterpret_cast<const unsigned char*>(data.data()), data.size(), digest);
+    static const char hex[] = "0123456789abcdef";
+    std::string out;
+    out.reserve(2 * SHA256_DIGEST_LENGTH);
+    for (unsigned char b : digest) {
+        out += hex[b >> 4];
+        out += hex[b & 0xF];
+    }
+    return out;
+}
+
+} // namespace
+
+MappedCover::~MappedCover() {
+    munmap(const_cast<char*>(data), size);
+}
+
+CoverStore::CoverStore(Options options, GoogleBooksAPI& api)
+    : options(std::move(options)), api(api) {
+    loadIndex();
+}
+
+bool CoverStore::isHash(const std::string& s) {
+    return s.size() == 2 * SHA256_DIGEST_LENGTH &&
+           std::all_of(s.begin(), s.end(), [](char c) { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'); });
+}
+
+std::string CoverStore::objectPath(const std::string& hash) const {
+    return options.root + "/objects/" + hash.substr(0, 2) + "/" + hash;
+}
+
+void CoverStore::loadIndex() {
+    fs::create_directories(options.root + "/objects");
+
+    // Covers on disk, oldest write last in LRU order
+    std::vector<std::pair<fs::file_time_type, Entry>> found;
+    std::vector<std::string> hashes;
+    for (const auto& dir : fs::directory_iterator(options.root + "/objects")) {
+        if (!dir.is_directory()) continue;
+        for (const auto& file : fs::directory_iterator(dir.path())) {
+            std::string name = file.path().filename().string();
+            if (!isHash(name)) {
+                // Leftover from a write interrupted by a crash
+                std::error_code ec;
+                fs::remove(file.path(), ec);
+                continue;
+            }
+            found.push_back({file.last_write_time(), Entry{file.file_size(), {}, nullptr}});
+            hashes.push_back(name);
+        }
+    }
+    std::vector<size_t> order(found.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return found[a].first > found[b].first; });
+    for (size_t i : order) {
+        lru.push_back(hashes[i]);
+        Entry entry = found[i].second;
+        entry.lru = std::prev(lru.end());
+        totalBytes += entry.size;
+        entries.emplace(hashes[i], std::move(entry));
+    }
+
+    // URL index: later lines win. Rewritten without dead entries so the
+    // log only grows by what this run fetches.
+    std::string logPath = options.root + "/urls";
+    {
+        std::ifstream in(logPath);
+        std::string hash, url;
+        while (in >> hash && std::getline(in >> std::ws, url)) {
+            if (isHash(hash)) urls[url] = hash;
+        }
+    }
+    {
+        std::ofstream out(logPath + ".tmp", std::ios::trunc);
+        for (auto it = urls.begin(); it != urls.end();) {
+            if (!entries.count(it->second)) {
+                it = urls.erase(it);
+                continue;
+            }
+            out << it->second << ' ' << it->first << '\n';
+            ++it;
+        }
+    }
+    fs::rename(logPath + ".tmp", logPath);
+    urlLog.open(logPath, std::ios::app);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    evict();
+}
+
+std::string CoverStore::resolve(const std::string& url) {
+    bool allowed = std::any_of(options.allowedPrefixes.begin(), options.allowedPrefixes.end(),
+                               [&](const std::string& prefix) { return url.rfind(prefix, 0) == 0; });
+    if (!allowed) throw std::invalid_argument("Cover URL is not from an allowed host");
+
+    std::promise<std::string> promise;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto known = urls.find(url);
+        if (known != urls.end() && entries.count(known->second)) return known->second;
+        auto pending = inflight.find(url);
+        if (pending != inflight.end()) {
+            auto shared = pending->second;
+            lock.unlock();
+            return shared.get();
+        }
+        inflight.emplace(url, promise.get_future().share());
+    }
+
+    std::string hash;
+    try {
+        hash = store(url, api.fetch(url, options.maxCoverBytes, options.fetchDeadline));
+        promise.set_value(hash);
+    } catch (...) {
+        promise.set_exception(std::current_exception());
+        std::lock_guard<std::mutex> lock(mutex);
+        inflight.erase(url);
+        throw;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    inflight.erase(url);
+    return hash;
+}
+
+std::string CoverStore::store(const std::string& url, GoogleBooksAPI::Download download) {
+    if (!sniffImage(download.body.data(), download.body.size())) {
+        throw std::invalid_argument("Cover URL did not return an image");
+    }
+    std::string hash = sha256Hex(download.body);
+    std::string path = objectPath(hash);
+
+    bool stored;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stored = entries.count(hash) > 0;
+    }
+    if (!stored) {
+        // Written aside and renamed, so a reader never maps a partial file
+        static std::atomic<unsigned> sequence{0};
+        fs::create_directories(fs::path(path).parent_path());
+        std::string temp = path + ".tmp" + std::to_string(sequence++);
+        {
+            std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+            out.write(download.body.data(), download.body.size());
+            if (!out.flush()) throw std::runtime_error("Cannot write " + temp);
+        }
+        fs::rename(temp, path);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!entries.count(hash)) {
+        lru.push_front(hash);
+        entries.emplace(hash, Entry{download.body.size(), lru.begin(), nullptr});
+        totalBytes += download.body.size();
+    }
+    urls[url] = hash;
+    urlLog << hash << ' ' << url << '\n' << std::flush;
+    evict();
+    return hash;
+}
+
+std::shared_ptr<const MappedCover> CoverStore::open(const std::string& hash) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(hash);
+    if (it == entries.end()) return nullptr;
+    Entry& entry = it->second;
+    touch(entry);
+    if (entry.mapped) return entry.mapped;
+
+    // Mapped once and kept with the entry, so serving a cover costs no
+    // file syscalls after the first request.
+    int fd = ::open(objectPath(hash).c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+        data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    if (fd >= 0) close(fd);
+    const char* type = data == MAP_FAILED ? nullptr : sniffImage(static_cast<const char*>(data), st.st_size);
+    if (!type) {
+        // Gone or damaged on disk; forget it so the URL is fetched again
+        if (data != MAP_FAILED) munmap(data, st.st_size);
+        std::cerr << "cover " << hash << " is unreadable; dropping it\n";
+        totalBytes -= entry.size;
+        lru.erase(entry.lru);
+        entries.erase(it);
+        return nullptr;
+    }
+    entry.mapped = std::make_shared<const MappedCover>(static_cast<const char*>(data), st.st_size, type);
+    return entry.mapped;
+}
+
+void CoverStore::touch(Entry& entry) {
+    lru.splice(lru.begin(), lru, entry.lru);
+}
+
+void CoverStore::evict() {
+    // The newest cover stays even if it alone is over the limit.
+    while (totalBytes > options.maxBytes && lru.size() > 1) {
+        const std::string& hash = lru.back();
+        auto it = entries.find(hash);
+        // Readers holding the mapping keep the bytes until they finish.
+        if (unlink(objectPath(hash).c_str()) != 0) {
+            std::cerr << "cannot evict cover " << hash << "\n";
+        }
+        totalBytes -= it->second.size;
+        entries.erase(it);
+        lru.pop_back();
+    }
+}
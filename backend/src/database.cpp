@@ -1,242 +1,405 @@
 #include "database.h"
+#include "metrics.h"
+#include "migrations.h"
+#include "sql.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
 #include <ctime>
-#include <sstream>
+#include <filesystem>
 #include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Parses the "%Y-%m-%dT%H:%M:%SZ" timestamps stored in sessions.expires_at.
+// Unparseable values map to 0, i.e. already expired.
+std::time_t parseISO(const std::string& iso) {
+    std::tm tm{};
+    std::istringstream ss(iso);
+    ss >> std::get_time(&tm, "%Y-%m-%dT%H:%M:%SZ");
+    if (ss.fail()) return 0;
+    return timegm(&tm);
+}
+
+// Inverse of parseISO.
+std::string formatISO(std::time_t t) {
+    std::tm tm{};
+    gmtime_r(&t, &tm);
+    std::ostringstream ss;
+    ss << std::put_time(&tm, "%Y-%m-%dT%H:%M:%SZ");
+    return ss.str();
+}
+
+// Fibonacci hashing: consecutive ids spread evenly over the shards, and
+// the result never depends on the build.
+int homeShard(int userId, int shards) {
+    uint64_t h = static_cast<uint64_t>(static_cast<uint32_t>(userId)) * 0x9E3779B97F4A7C15ull;
+    return static_cast<int>((h >> 32) % static_cast<uint64_t>(shards));
+}
+
+// Creates dataDir if needed and returns the directory database's path.
+std::string directoryPath(const std::string& dataDir) {
+    fs::create_directories(dataDir);
+    return dataDir + "/directory.sqlite";
+}
+
+// Whole-file fcntl lock. These belong to the process, so they never
+// conflict with the process's own locks, and a read lock is upgraded or
+// downgraded in place.
+bool lockFile(int fd, short type, bool wait) {
+    struct flock lock{};
+    lock.l_type = type;
+    lock.l_whence = SEEK_SET;
+    return fcntl(fd, wait ? F_SETLKW : F_SETLK, &lock) == 0;
+}
+
+// Does another process hold a lock on fd's file?
+bool lockedElsewhere(int fd) {
+    struct flock lock{};
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    return fcntl(fd, F_GETLK, &lock) == 0 && lock.l_type != F_UNLCK;
+}
+
+metrics::Histogram& methodTiming(const char* method) {
+    return metrics::registry().histogram("booktracker_db_seconds", "Time spent in Database methods",
+                                         std::string("method=\"") + method + "\"");
+}
+
+} // namespace
+
+Database::Database(const std::string& dataDir) : Database(dataDir, Options()) {}
+
+Database::Database(const std::string& dataDir, const Options& options)
+    : dataDir(dataDir),
+      placementShards(std::max(options.shards, 1)),
+      directory(directoryPath(dataDir)),
+      ids(directory) {
+    std::string lockPath = dataDir + "/process.lock";
+    processLock = open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (processLock < 0) throw std::runtime_error("cannot open " + lockPath);
+    // Waits while another process is moving a user
+    lockFile(processLock, F_RDLCK, true);
+    if (lockedElsewhere(processLock)) {
+        std::cerr << "database: another process is using " << dataDir
+                  << "; its moves, logouts and edits will not be seen here, and moveUser is disabled\n";
+    }
+    {
+        auto conn = directory.writer();
+        migrateDirectory(*conn);
+    }
+    if (!options.legacyPath.empty() && fs::exists(options.legacyPath) && !fs::exists(shardPath(dataDir, 0))) {
+        adoptLegacy(options.legacyPath);
+    }
+
+    // Every shard a user was ever placed on is opened, even past
+    // options.shards.
+    int count = placementShards;
+    {
+        auto conn = directory.reader();
+        auto q = conn->prepare("SELECT COALESCE(MAX(shard), 0) FROM users");
+        q->executeStep();
+        count = std::max(count, q->getColumn(0).getInt() + 1);
+    }
+    for (int i = 0; i < count; ++i) {
+        shards.push_back(std::make_unique<Shard>(shardPath(dataDir, i), ids, options.readers));
+    }
+
+    // Expired logins are never looked up again; drop them via the
+    // expires_at index.
+    auto conn = directory.writer();
+    auto q = conn->prepare("DELETE FROM sessions WHERE expires_at <= ?");
+    sql::bind(*q, formatISO(std::time(nullptr)));
+    q->exec();
+}
+
+Database::~Database() {
+    if (processLock >= 0) close(processLock);
+}
+
+std::string Database::shardPath(const std::string& dataDir, int shard) {
+    char name[32];
+    std::snprintf(name, sizeof name, "/shard-%02d.sqlite", shard);
+    return dataDir + name;
+}
 
-Database::Database(const std::string& dbPath)
-    : db(dbPath, SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE) {
-    // Users table
-    db.exec(R"(
-        CREATE TABLE IF NOT EXISTS users (
-            id INTEGER PRIMARY KEY AUTOINCREMENT,
-            username TEXT UNIQUE,
-            password_hash TEXT
-        )
-    )");
-
-    // Sessions table
-    db.exec(R"(
-        CREATE TABLE IF NOT EXISTS sessions (
-            token TEXT PRIMARY KEY,
-            user_id INTEGER,
-            expires_at TEXT,
-            FOREIGN KEY(user_id) REFERENCES users(id)
-        )
-    )");
-
-    // Books table (per user)
-    db.exec(R"(
-        CREATE TABLE IF NOT EXISTS books (
-            id INTEGER PRIMARY KEY AUTOINCREMENT,
-            user_id INTEGER,
-            title TEXT,
-            author TEXT,
-            genre TEXT,
-            status TEXT,
-            pages_read INTEGER DEFAULT 0,
-            total_pages INTEGER DEFAULT 0,
-            notes TEXT,
-            tags TEXT DEFAULT '',
-            goal_end_date TEXT DEFAULT '',
-            thumbnail TEXT,
-            rating INTEGER DEFAULT 3,
-            FOREIGN KEY(user_id) REFERENCES users(id)
-        )
-    )");
-
-    // Reading sessions table
-    db.exec(R"(
-        CREATE TABLE IF NOT EXISTS reading_sessions (
-            id INTEGER PRIMARY KEY AUTOINCREMENT,
-            user_id INTEGER,
-            book_id INTEGER,
-            start_time TEXT,
-            start_pages_read INTEGER,
-            end_time TEXT,
-            end_pages_read INTEGER,
-            FOREIGN KEY(user_id) REFERENCES users(id),
-            FOREIGN KEY(book_id) REFERENCES books(id)
-        )
-    )");
-
-    // Migrate old books schema if needed
-    try { db.exec("ALTER TABLE books ADD COLUMN user_id INTEGER DEFAULT 0"); }       catch(...) {}
-    try { db.exec("ALTER TABLE books ADD COLUMN pages_read INTEGER DEFAULT 0"); }    catch(...) {}
-    try { db.exec("ALTER TABLE books ADD COLUMN total_pages INTEGER DEFAULT 0"); }   catch(...) {}
-    try { db.exec("ALTER TABLE books ADD COLUMN tags TEXT DEFAULT ''"); }            catch(...) {}
-    try { db.exec("ALTER TABLE books ADD COLUMN goal_end_date TEXT DEFAULT ''"); }   catch(...) {}
-}
-
-nlohmann::json Database::getBooks(int userId) {
-    nlohmann::json arr = nlohmann::json::array();
-    SQLite::Statement q(db,
-        "SELECT id, title, author, genre, status, pages_read, total_pages, notes, tags, goal_end_date, thumbnail, rating "
-        "FROM books WHERE user_id = ?");
-    q.bind(1, userId);
-
-    while (q.executeStep()) {
-        nlohmann::json b;
-        b["id"]          = q.getColumn("id").getInt();
-        b["title"]       = q.getColumn("title").getText();
-        b["author"]      = q.getColumn("author").getText();
-        b["genre"]       = q.getColumn("genre").getText();
-        b["status"]      = q.getColumn("status").getText();
-        b["pagesRead"]   = q.getColumn("pages_read").getInt();
-        b["totalPages"]  = q.getColumn("total_pages").getInt();
-        b["notes"]       = q.getColumn("notes").getText();
-        b["tags"]        = q.getColumn("tags").getText();
-        b["goalEndDate"] = q.getColumn("goal_end_date").getText();
-        b["thumbnail"]   = q.getColumn("thumbnail").getText();
-        b["rating"]      = q.getColumn("rating").getInt();
-        arr.push_back(b);
+void Database::adoptLegacy(const std::string& legacyPath) {
+    {
+        // Fold the WAL into the file, so it can be renamed on its own.
+        SQLite::Database legacy(legacyPath, SQLite::OPEN_READWRITE);
+        legacy.exec("PRAGMA wal_checkpoint(TRUNCATE)");
     }
+    auto conn = directory.writer();
+    bool empty;
+    {
+        auto q = conn->prepare("SELECT NOT EXISTS (SELECT 1 FROM users)");
+        q->executeStep();
+        empty = q->getColumn(0).getInt() != 0;
+    }
+    // A directory that already has users got them from an earlier attempt
+    // that stopped before the rename below.
+    if (empty) {
+        {
+            SQLite::Statement attach(*conn, "ATTACH DATABASE ? AS legacy");
+            attach.bind(1, legacyPath);
+            attach.exec();
+        }
+        try {
+            SQLite::Transaction tx(*conn);
+            conn->exec(R"(
+                INSERT INTO users (id, username, password_hash, shard)
+                SELECT id, username, password_hash, 0 FROM legacy.users
+            )");
+            conn->exec(R"(
+                INSERT INTO sessions (token, user_id, expires_at)
+                SELECT token, user_id, expires_at FROM legacy.sessions
+            )");
+            // New ids continue past every id the old file ever issued.
+            for (std::string table : {"books", "reading_sessions"}) {
+                SQLite::Statement q(*conn,
+                    "UPDATE id_sequences SET next = MAX(next, "
+                    "1 + COALESCE((SELECT seq FROM legacy.sqlite_sequence WHERE name = ?1), 0), "
+                    "1 + COALESCE((SELECT MAX(id) FROM legacy." + table + "), 0)) "
+                    "WHERE name = ?1");
+                q.bind(1, table);
+                q.exec();
+            }
+            tx.commit();
+        } catch (...) {
+            conn->exec("DETACH DATABASE legacy");
+            throw;
+        }
+        conn->exec("DETACH DATABASE legacy");
+    }
+    fs::rename(legacyPath, shardPath(dataDir, 0));
+    std::error_code ec;
+    fs::remove(legacyPath + "-wal", ec);
+    fs::remove(legacyPath + "-shm", ec);
+    std::cerr << "database: adopted " << legacyPath << " as shard 0\n";
+}
 
-    return arr;
-}
-
-void Database::addBook(int userId,
-                       const std::string& title,
-                       const std::string& author,
-                       const std::string& genre,
-                       const std::string& status,
-                       int pagesRead,
-                       int totalPages,
-                       const std::string& notes,
-                       const std::string& tags,
-                       const std::string& goalEndDate,
-                       const std::string& thumbnail,
-                       int rating) {
-    SQLite::Statement q(db, R"(
-        INSERT INTO books
-            (user_id, title, author, genre, status,
-             pages_read, total_pages, notes, tags,
-             goal_end_date, thumbnail, rating)
-        VALUES (?,?,?,?,?,?,?,?,?,?,?,?)
-    )");
-    q.bind(1,  userId);
-    q.bind(2,  title);
-    q.bind(3,  author);
-    q.bind(4,  genre);
-    q.bind(5,  status);
-    q.bind(6,  pagesRead);
-    q.bind(7,  totalPages);
-    q.bind(8,  notes);
-    q.bind(9,  tags);
-    q.bind(10, goalEndDate);
-    q.bind(11, thumbnail);
-    q.bind(12, rating);
-    q.exec();
-}
-
-void Database::updateBook(int id, int userId,
-                          const std::string& status,
-                          int pagesRead,
-                          int totalPages,
-                          const std::string& notes,
-                          const std::string& tags,
-                          const std::string& goalEndDate,
-                          const std::string& thumbnail,
-                          int rating) {
-    SQLite::Statement q(db, R"(
-        UPDATE books SET
-            status        = ?,
-            pages_read    = ?,
-            total_pages   = ?,
-            notes         = ?,
-            tags          = ?,
-            goal_end_date = ?,
-            thumbnail     = ?,
-            rating        = ?
-        WHERE id = ? AND user_id = ?
-    )");
-    q.bind(1,  status);
-    q.bind(2,  pagesRead);
-    q.bind(3,  totalPages);
-    q.bind(4,  notes);
-    q.bind(5,  tags);
-    q.bind(6,  goalEndDate);
-    q.bind(7,  thumbnail);
-    q.bind(8,  rating);
-    q.bind(9,  id);
-    q.bind(10, userId);
-    q.exec();
+int Database::shardOf(int userId) {
+    {
+        std::shared_lock<std::shared_mutex> lock(placementMutex);
+        auto it = placements.find(userId);
+        if (it != placements.end()) return it->second;
+    }
+    int shard;
+    {
+        auto conn = directory.reader();
+        auto q = conn->prepare("SELECT shard FROM users WHERE id = ?");
+        sql::bind(*q, userId);
+        // Not a user; nothing of theirs exists anywhere.
+        if (!q->executeStep()) return homeShard(userId, placementShards);
+        shard = q->getColumn(0).getInt();
+    }
+    std::unique_lock<std::shared_mutex> lock(placementMutex);
+    return placements.try_emplace(userId, shard).first->second;
+}
+
+Database::Pin Database::pin(int userId) {
+    Stripe& stripe = stripeOf(userId);
+    {
+        std::unique_lock<std::mutex> lock(stripe.mutex);
+        stripe.changed.wait(lock, [&] { return stripe.moving != userId; });
+        ++stripe.active[userId];
+    }
+    // Looked up after registering, so the user cannot move in between.
+    // The lookup queries the directory and may throw; no Pin exists yet
+    // to drop the count, so drop it here or a move would wait forever.
+    Shard* shard;
+    try {
+        shard = shards[shardOf(userId)].get();
+    } catch (...) {
+        unpin(stripe, userId);
+        throw;
+    }
+    return Pin(stripe, userId, *shard);
+}
+
+void Database::unpin(Stripe& stripe, int userId) {
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    auto it = stripe.active.find(userId);
+    if (--it->second == 0) {
+        stripe.active.erase(it);
+        if (stripe.moving == userId) stripe.changed.notify_all();
+    }
+}
+
+Database::Pin::~Pin() {
+    unpin(stripe, userId);
+}
+
+int Database::moveUser(int userId, int to) {
+    static metrics::Histogram& timing = methodTiming("moveUser");
+    metrics::Timer timer(timing);
+    if (to < 0 || to >= shardCount()) {
+        throw std::invalid_argument("No shard " + std::to_string(to));
+    }
+    std::lock_guard<std::mutex> serial(moveMutex);
+    // Exclusive for the move: fails while another process has the
+    // directory open, and makes new ones wait until it is done.
+    if (!lockFile(processLock, F_WRLCK, false)) {
+        throw MoveConflict("another process is using the data directory; "
+                           "stop it before moving users");
+    }
+    struct Downgrade {
+        int fd;
+        ~Downgrade() { lockFile(fd, F_RDLCK, true); }
+    } downgrade{processLock};
+    {
+        auto conn = directory.reader();
+        auto q = conn->prepare("SELECT 1 FROM users WHERE id = ?");
+        sql::bind(*q, userId);
+        if (!q->executeStep()) throw std::invalid_argument("No user " + std::to_string(userId));
+    }
+
+    // Hold the user's new calls and let running ones finish.
+    Stripe& stripe = stripeOf(userId);
+    {
+        std::unique_lock<std::mutex> lock(stripe.mutex);
+        stripe.moving = userId;
+        stripe.changed.wait(lock, [&] { return stripe.active.count(userId) == 0; });
+    }
+    struct Release {
+        Stripe& stripe;
+        ~Release() {
+            {
+                std::lock_guard<std::mutex> lock(stripe.mutex);
+                stripe.moving = 0;
+            }
+            stripe.changed.notify_all();
+        }
+    } release{stripe};
+
+    int from = shardOf(userId);
+    if (from == to) return from;
+    // Copy, switch, then delete: a crash at any point leaves the directory
+    // pointing at a complete copy.
+    shards[from]->flushUser(userId);
+    shards[to]->copyUser(userId, shards[from]->path());
+    {
+        auto conn = directory.writer();
+        auto q = conn->prepare("UPDATE users SET shard = ? WHERE id = ?");
+        sql::bind(*q, to, userId);
+        q->exec();
+    }
+    {
+        std::unique_lock<std::shared_mutex> lock(placementMutex);
+        placements[userId] = to;
+    }
+    try {
+        shards[from]->dropUser(userId);
+    } catch (const std::exception& e) {
+        // The move itself is done; the old rows are only dead weight, and a
+        // later move back replaces them.
+        std::cerr << "database: moved user " << userId << " but could not clear shard " << from
+                  << ": " << e.what() << "\n";
+    }
+    return from;
+}
+
+// Book methods, routed to the user's shard
+
+bool Database::streamBooks(int userId, const BookQuery& query, const JsonWriter::Sink& sink) {
+    return pin(userId)->streamBooks(userId, query, sink);
+}
+
+bool Database::streamChanges(int userId, int64_t since, const JsonWriter::Sink& sink) {
+    return pin(userId)->streamChanges(userId, since, sink);
+}
+
+bool Database::streamSearch(int userId, const std::string& text, int limit, int offset,
+                            const JsonWriter::Sink& sink) {
+    return pin(userId)->streamSearch(userId, text, limit, offset, sink);
+}
+
+void Database::addBook(int userId, const BookInput& book) {
+    pin(userId)->addBook(userId, book);
+}
+
+void Database::importBooks(int userId, const std::vector<NewBook>& books) {
+    pin(userId)->importBooks(userId, books);
+}
+
+void Database::updateBook(int id, int userId, const BookInput& book) {
+    pin(userId)->updateBook(id, userId, book);
 }
 
 void Database::deleteBook(int id, int userId) {
-    SQLite::Statement q(db,
-        "DELETE FROM books WHERE id = ? AND user_id = ?");
-    q.bind(1, id);
-    q.bind(2, userId);
-    q.exec();
+    pin(userId)->deleteBook(id, userId);
 }
 
-// Reading-session implementations
+LibraryStats Database::getAnalytics(int userId) {
+    return pin(userId)->getAnalytics(userId);
+}
+
+int Database::rebuildAnalytics() {
+    int mismatched = 0;
+    for (auto& shard : shards) mismatched += shard->rebuildAnalytics();
+    return mismatched;
+}
 
-void Database::startReadingSession(int userId,
+int64_t Database::dataVersion(int userId) {
+    return pin(userId)->dataVersion(userId);
+}
+
+bool Database::startReadingSession(int userId,
                                    int bookId,
                                    const std::string& startTime,
                                    int startPagesRead,
                                    int& outSessionId) {
-    SQLite::Statement q(db, R"(
-        INSERT INTO reading_sessions
-            (user_id, book_id, start_time, start_pages_read)
-        VALUES (?,?,?,?)
-    )");
-    q.bind(1, userId);
-    q.bind(2, bookId);
-    q.bind(3, startTime);
-    q.bind(4, startPagesRead);
-    q.exec();
-    outSessionId = static_cast<int>(db.getLastInsertRowid());
-}
-
-void Database::stopReadingSession(int sessionId,
+    return pin(userId)->startReadingSession(userId, bookId, startTime, startPagesRead, outSessionId);
+}
+
+bool Database::stopReadingSession(int userId,
+                                  int bookId,
+                                  int sessionId,
                                   const std::string& endTime,
                                   int endPagesRead) {
-    SQLite::Statement q(db, R"(
-        UPDATE reading_sessions
-        SET end_time = ?, end_pages_read = ?
-        WHERE id = ?
-    )");
-    q.bind(1, endTime);
-    q.bind(2, endPagesRead);
-    q.bind(3, sessionId);
-    q.exec();
+    return pin(userId)->stopReadingSession(userId, bookId, sessionId, endTime, endPagesRead);
 }
 
 std::vector<ReadingSession> Database::getReadingSessions(int userId) {
-    std::vector<ReadingSession> out;
-    SQLite::Statement q(db, R"(
-        SELECT id, book_id, start_time, end_time,
-               (end_pages_read - start_pages_read) AS pages_read
-        FROM reading_sessions
-        WHERE user_id = ?
-    )");
-    q.bind(1, userId);
-
-    while (q.executeStep()) {
-        ReadingSession s;
-        s.id        = q.getColumn("id").getInt();
-        s.bookId    = q.getColumn("book_id").getInt();
-        s.startTime = q.getColumn("start_time").getText();
-        s.endTime   = q.getColumn("end_time").getText();
-        s.pagesRead = q.getColumn("pages_read").getInt();
-        out.push_back(s);
-    }
+    return pin(userId)->getReadingSessions(userId);
+}
 
-    return out;
+ReadingSummary Database::getReadingSummary(int userId,
+                                           const std::string& from,
+                                           const std::string& to,
+                                           const std::string& today) {
+    return pin(userId)->getReadingSummary(userId, from, to, today);
 }
 
 // User & session methods
 
 bool Database::createUser(const std::string& username,
                           const std::string& passwordHash) {
+    static metrics::Histogram& timing = methodTiming("createUser");
+    metrics::Timer timer(timing);
     try {
-        SQLite::Statement q(db,
-            "INSERT INTO users (username,password_hash) VALUES (?,?)");
-        q.bind(1, username);
-        q.bind(2, passwordHash);
-        q.exec();
+        auto conn = directory.writer();
+        SQLite::Transaction tx(*conn);
+        int userId;
+        {
+            auto q = conn->prepare(
+                "INSERT INTO users (username,password_hash) VALUES (?,?) RETURNING id");
+            sql::bind(*q, username, passwordHash);
+            q->executeStep();
+            userId = q->getColumn(0).getInt();
+        }
+        {
+            auto q = conn->prepare("UPDATE users SET shard = ? WHERE id = ?");
+            sql::bind(*q, homeShard(userId, placementShards), userId);
+            q->exec();
+        }
+        tx.commit();
         return true;
     } catch (...) {
         return false;
@@ -245,14 +408,17 @@ bool Database::createUser(const std::string& username,
 
 std::optional<std::pair<int, std::string>>
 Database::getUserByUsername(const std::string& username) {
-    SQLite::Statement q(db,
+    static metrics::Histogram& timing = methodTiming("getUserByUsername");
+    metrics::Timer timer(timing);
+    auto conn = directory.reader();
+    auto q = conn->prepare(
         "SELECT id, password_hash FROM users WHERE username = ?");
-    q.bind(1, username);
+    sql::bind(*q, username);
 
-    if (q.executeStep()) {
+    if (q->executeStep()) {
         return std::make_pair(
-            q.getColumn(0).getInt(),
-            q.getColumn(1).getText()
+            q->getColumn(0).getInt(),
+            std::string(q->getColumn(1).getText())
         );
     }
     return std::nullopt;
@@ -261,33 +427,55 @@ Database::getUserByUsername(const std::string& username) {
 void Database::createSession(const std::string& token,
                              int userId,
                              const std::string& expiresAt) {
-    SQLite::Statement q(db,
-        "INSERT INTO sessions (token,user_id,expires_at) VALUES (?,?,?)");
-    q.bind(1, token);
-    q.bind(2, userId);
-    q.bind(3, expiresAt);
-    q.exec();
+    static metrics::Histogram& timing = methodTiming("createSession");
+    metrics::Timer timer(timing);
+    {
+        auto conn = directory.writer();
+        auto q = conn->prepare(
+            "INSERT INTO sessions (token,user_id,expires_at) VALUES (?,?,?)");
+        sql::bind(*q, token, userId, expiresAt);
+        q->exec();
+    }
+    sessionCache.put(token, userId, parseISO(expiresAt));
 }
 
 std::optional<int> Database::getUserIdBySession(const std::string& token) {
-    SQLite::Statement q(db,
-        "SELECT user_id FROM sessions WHERE token = ? AND expires_at > ?");
-    q.bind(1, token);
-
-    std::time_t t = std::time(nullptr);
-    std::ostringstream iso;
-    iso << std::put_time(std::gmtime(&t), "%Y-%m-%dT%H:%M:%SZ");
-    q.bind(2, iso.str());
+    static metrics::Histogram& timing = methodTiming("getUserIdBySession");
+    metrics::Timer timer(timing);
+    std::time_t now = std::time(nullptr);
+    auto cached = sessionCache.get(token, now);
+    if (cached.status == SessionCache::Status::Hit)     return cached.userId;
+    if (cached.status == SessionCache::Status::Expired) return std::nullopt;
 
-    if (q.executeStep()) {
-        return q.getColumn(0).getInt();
+    // Not cached yet (e.g. created before this process started).
+    uint64_t generation = sessionCache.generation(token);
+    int userId;
+    std::time_t expiresAt;
+    {
+        auto conn = directory.reader();
+        auto q = conn->prepare(
+            "SELECT user_id, expires_at FROM sessions WHERE token = ?");
+        sql::bind(*q, token);
+        if (!q->executeStep()) return std::nullopt;
+        userId    = q->getColumn(0).getInt();
+        expiresAt = parseISO(q->getColumn(1).getText());
     }
-    return std::nullopt;
+    if (expiresAt <= now) return std::nullopt;
+    sessionCache.fill(token, userId, expiresAt, generation);
+    return userId;
 }
 
 void Database::deleteSession(const std::string& token) {
-    SQLite::Statement q(db,
-        "DELETE FROM sessions WHERE token = ?");
-    q.bind(1, token);
-    q.exec();
+    static metrics::Histogram& timing = methodTiming("deleteSession");
+    metrics::Timer timer(timing);
+    {
+        auto conn = directory.writer();
+        auto q = conn->prepare(
+            "DELETE FROM sessions WHERE token = ?");
+        sql::bind(*q, token);
+        q->exec();
+    }
+    // After the DELETE, so a lookup that read the row before it cannot
+    // cache it again (see SessionCache::fill)
+    sessionCache.erase(token);
 }
@@ -0,0 +1,27 @@
+#include "id_allocator.h"
+#include "sql.h"
+#include <algorithm>
+#include <stdexcept>
+
+IdAllocator::IdAllocator(ConnectionPool& directory, int64_t blockSize)
+    : directory(directory), blockSize(blockSize) {}
+
+int64_t IdAllocator::take(const std::string& sequence, int64_t count) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Block& block = blocks[sequence];
+    if (block.end - block.next < count) {
+        // Whatever is left of the old block is skipped, keeping a batch's
+        // ids consecutive.
+        int64_t reserve = std::max(count, blockSize);
+        auto conn = directory.writer();
+        auto q = conn->prepare(
+            "UPDATE id_sequences SET next = next + ? WHERE name = ? RETURNING next");
+        sql::bind(*q, reserve, sequence);
+        if (!q->executeStep()) throw std::logic_error("unknown id sequence " + sequence);
+        block.end = q->getColumn(0).getInt64();
+        block.next = block.end - reserve;
+    }
+    int64_t first = block.next;
+    block.next += count;
+    return first;
+}
@@ -0,0 +1,178 @@
+#include "id_bitmap.h"
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+constexpr size_t bitsetWords = 65536 / 64;
+
+template <typename Pairs>
+auto findKey(Pairs& containers, uint16_t key) {
+    return std::lower_bound(containers.begin(), containers.end(), key,
+        [](const auto& c, uint16_t k) { return c.first < k; });
+}
+
+} // namespace
+
+void IdBitmap::Container::add(uint16_t low) {
+    if (dense()) {
+        uint64_t& word = bits[low >> 6];
+        uint64_t mask = uint64_t(1) << (low & 63);
+        if (!(word & mask)) {
+            word |= mask;
+            ++count;
+        }
+        return;
+    }
+    // Ids usually arrive in ascending order, so appending is the fast path.
+    if (array.empty() || array.back() < low) {
+        array.push_back(low);
+    } else {
+        auto it = std::lower_bound(array.begin(), array.end(), low);
+        if (*it == low) return;
+        array.insert(it, low);
+    }
+    ++count;
+    if (count > arrayLimit) toBitset();
+}
+
+bool IdBitmap::Container::contains(uint16_t low) const {
+    if (dense()) return bits[low >> 6] >> (low & 63) & 1;
+    return std::binary_search(array.begin(), array.end(), low);
+}
+
+void IdBitmap::Container::toBitset() {
+    bits.assign(bitsetWords, 0);
+    for (uint16_t low : array) bits[low >> 6] |= uint64_t(1) << (low & 63);
+    array.clear();
+    array.shrink_to_fit();
+}
+
+void IdBitmap::Container::toArrayIfSparse() {
+    if (!dense() || count > arrayLimit) return;
+    array.reserve(count);
+    for (size_t w = 0; w < bitsetWords; ++w) {
+        for (uint64_t word = bits[w]; word; word &= word - 1) {
+            array.push_back(static_cast<uint16_t>(w * 64 + __builtin_ctzll(word)));
+        }
+    }
+    bits.clear();
+    bits.shrink_to_fit();
+}
+
+IdBitmap::Container IdBitmap::intersect(const Container& a, const Container& b) {
+    Container out;
+    if (a.dense() && b.dense()) {
+        out.bits.resize(bitsetWords);
+        for (size_t w = 0; w < bitsetWords; ++w) {
+            out.bits[w] = a.bits[w] & b.bits[w];
+            out.count += __builtin_popcountll(out.bits[w]);
+        }
+        out.toArrayIfSparse();
+    } else if (a.dense() || b.dense()) {
+        const Container& sparse = a.dense() ? b : a;
+        const Container& dense  = a.dense() ? a : b;
+        for (uint16_t low : sparse.array) {
+            if (dense.contains(low)) out.array.push_back(low);
+        }
+        out.count = out.array.size();
+    } else {
+        std::set_intersection(a.array.begin(), a.array.end(),
+                              b.array.begin(), b.array.end(),
+                              std::back_inserter(out.array));
+        out.count = out.array.size();
+    }
+    return out;
+}
+
+void IdBitmap::unite(Container& into, const Container& from) {
+    if (!into.dense() && !from.dense() && into.count + from.count <= arrayLimit) {
+        std::vector<uint16_t> merged;
+        merged.reserve(into.count + from.count);
+        std::set_union(into.array.begin(), into.array.end(),
+                       from.array.begin(), from.array.end(),
+                       std::back_inserter(merged));
+        into.array.swap(merged);
+        into.count = into.array.size();
+        return;
+    }
+    if (!into.dense()) into.toBitset();
+    if (from.dense()) {
+        into.count = 0;
+        for (size_t w = 0; w < bitsetWords; ++w) {
+            into.bits[w] |= from.bits[w];
+            into.count += __builtin_popcountll(into.bits[w]);
+        }
+    } else {
+        for (uint16_t low : from.array) into.add(low);
+    }
+}
+
+void IdBitmap::add(uint32_t id) {
+    uint16_t key = static_cast<uint16_t>(id >> 16);
+    auto it = findKey(containers, key);
+    if (it == containers.end() || it->first != key) {
+        it = containers.insert(it, {key, Container{}});
+    }
+    it->second.add(static_cast<uint16_t>(id));
+}
+
+bool IdBitmap::contains(uint32_t id) const {
+    uint16_t key = static_cast<uint16_t>(id >> 16);
+    auto it = findKey(containers, key);
+    return it != containers.end() && it->first == key && it->second.contains(static_cast<uint16_t>(id));
+}
+
+size_t IdBitmap::size() const {
+    size_t n = 0;
+    for (const auto& [key, c] : containers) n += c.count;
+    return n;
+}
+
+IdBitmap IdBitmap::operator&(const IdBitmap& other) const {
+    IdBitmap out;
+    auto a = containers.begin(), b = other.containers.begin();
+    while (a != containers.end() && b != other.containers.end()) {
+        if (a->first < b->first) {
+            ++a;
+        } else if (b->first < a->first) {
+            ++b;
+        } else {
+            Container c = intersect(a->second, b->second);
+            if (c.count > 0) out.containers.emplace_back(a->first, std::move(c));
+            ++a;
+            ++b;
+        }
+    }
+    return out;
+}
+
+IdBitmap& IdBitmap::operator|=(const IdBitmap& other) {
+    for (const auto& [key, c] : other.containers) {
+        auto it = findKey(containers, key);
+        if (it == containers.end() || it->first != key) {
+            containers.insert(it, {key, c});
+        } else {
+            unite(it->second, c);
+        }
+    }
+    return *this;
+}
+
+std::vector<uint32_t> IdBitmap::toVector() const {
+    std::vector<uint32_t> out;
+    out.reserve(size());
+    for (const auto& [key, c] : containers) {
+        uint32_t high = uint32_t(key) << 16;
+        if (c.dense()) {
+            for (size_t w = 0; w < bitsetWords; ++w) {
+                for (uint64_t word = c.bits[w]; word; word &= word - 1) {
+                    out.push_back(high | static_cast<uint32_t>(w * 64 + __builtin_ctzll(word)));
+                }
+            }
+        } else {
+            for (uint16_t low : c.array) out.push_back(high | low);
+        }
+    }
+    return out;
+}
@@ -0,0 +1,81 @@
+#include "json_writer.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+JsonWriter::JsonWriter(Sink sink, size_t bufferSize)
+    : sink(std::move(sink)), buffer(bufferSize) {}
+
+void JsonWriter::append(const char* data, size_t size) {
+    while (size > 0 && healthy) {
+        if (used == buffer.size() && !flush()) return;
+        size_t n = std::min(size, buffer.size() - used);
+        std::memcpy(buffer.data() + used, data, n);
+        used += n;
+        data += n;
+        size -= n;
+    }
+}
+
+bool JsonWriter::flush() {
+    if (healthy && used > 0) {
+        healthy = sink(buffer.data(), used);
+        used = 0;
+    }
+    return healthy;
+}
+
+JsonWriter& JsonWriter::raw(std::string_view text) {
+    append(text.data(), text.size());
+    return *this;
+}
+
+JsonWriter& JsonWriter::key(std::string_view name) {
+    string(name);
+    append(":", 1);
+    return *this;
+}
+
+JsonWriter& JsonWriter::string(std::string_view value) {
+    append("\"", 1);
+    // Copy runs of characters that need no escaping in one go.
+    size_t runStart = 0;
+    for (size_t i = 0; i < value.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(value[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+        append(value.data() + runStart, i - runStart);
+        runStart = i + 1;
+        switch (c) {
+            case '"':  append("\\\"", 2); break;
+            case '\\': append("\\\\", 2); break;
+            case '\n': append("\\n", 2);  break;
+            case '\r': append("\\r", 2);  break;
+            case '\t': append("\\t", 2);  break;
+            case '\b': append("\\b", 2);  break;
+            case '\f': append("\\f", 2);  break;
+            default: {
+                char esc[7];
+                std::snprintf(esc, sizeof esc, "\\u%04x", c);
+                append(esc, 6);
+            }
+        }
+    }
+    append(value.data() + runStart, value.size() - runStart);
+    append("\"", 1);
+    return *this;
+}
+
+JsonWriter& JsonWriter::number(int64_t value) {
+    char digits[24];
+    int n = std::snprintf(digits, sizeof digits, "%lld", static_cast<long long>(value));
+    append(digits, n);
+    return *this;
+}
+
+JsonWriter& JsonWriter::number(double value) {
+    char digits[32];
+    int n = std::snprintf(digits, sizeof digits, "%.17g", value);
+    append(digits, n);
+    return *this;
+}
@@ -0,0 +1,158 @@
+#include "metrics.h"
+#include <cstdio>
+
+namespace metrics {
+
+size_t threadShard() {
+    // Round-robin on first use spreads threads evenly over the shards.
+    static std::atomic<size_t> next{0};
+    thread_local size_t shard = next.fetch_add(1, std::memory_order_relaxed) % shardCount;
+    return shard;
+}
+
+void Counter::add(uint64_t n) {
+    shards[threadShard()].value.fetch_add(n, std::memory_order_relaxed);
+}
+
+uint64_t Counter::value() const {
+    uint64_t total = 0;
+    for (const Shard& s : shards) total += s.value.load(std::memory_order_relaxed);
+    return total;
+}
+
+void Gauge::add(int64_t n) {
+    shards[threadShard()].value.fetch_add(n, std::memory_order_relaxed);
+}
+
+int64_t Gauge::value() const {
+    int64_t total = 0;
+    for (const Shard& s : shards) total += s.value.load(std::memory_order_relaxed);
+    return total;
+}
+
+size_t Histogram::bucketFor(uint64_t micros) {
+    if (micros < subBuckets) return static_cast<size_t>(micros);
+    int exponent = 63 - __builtin_clzll(micros);
+    size_t sub = (micros >> (exponent - subBits)) & (subBuckets - 1);
+    size_t bucket = subBuckets + (exponent - subBits) * subBuckets + sub;
+    return bucket < bucketCount ? bucket : bucketCount - 1;
+}
+
+uint64_t Histogram::upperBound(size_t bucket) {
+    if (bucket < subBuckets) return bucket + 1;
+    size_t exponent = (bucket - subBuckets) / subBuckets + subBits;
+    size_t sub = (bucket - subBuckets) % subBuckets;
+    return (subBuckets + sub + 1) << (exponent - subBits);
+}
+
+void Histogram::record(std::chrono::nanoseconds elapsed) {
+    recordMicros(static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()));
+}
+
+void Histogram::recordMicros(uint64_t micros) {
+    Shard& shard = shards[threadShard()];
+    shard.counts[bucketFor(micros)].fetch_add(1, std::memory_order_relaxed);
+    shard.sumMicros.fetch_add(micros, std::memory_order_relaxed);
+}
+
+Histogram::Snapshot Histogram::snapshot() const {
+    Snapshot snap;
+    for (const Shard& shard : shards) {
+        for (size_t i = 0; i < bucketCount; ++i) {
+            uint64_t n = shard.counts[i].load(std::memory_order_relaxed);
+            snap.counts[i] += n;
+            snap.count += n;
+        }
+        snap.sumMicros += shard.sumMicros.load(std::memory_order_relaxed);
+    }
+    return snap;
+}
+
+Registry::Family& Registry::family(const std::string& name, const char* type, const std::string& help) {
+    Family& f = families[name];
+    if (f.type.empty()) {
+        f.type = type;
+        f.help = help;
+    }
+    return f;
+}
+
+Counter& Registry::counter(const std::string& name, const std::string& help, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& slot = family(name, "counter", help).counters[labels];
+    if (!slot) slot = std::make_unique<Counter>();
+    return *slot;
+}
+
+Gauge& Registry::gauge(const std::string& name, const std::string& help, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& slot = family(name, "gauge", help).gauges[labels];
+    if (!slot) slot = std::make_unique<Gauge>();
+    return *slot;
+}
+
+Histogram& Registry::histogram(const std::string& name, const std::string& help, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& slot = family(name, "histogram", help).histograms[labels];
+    if (!slot) slot = std::make_unique<Histogram>();
+    return *slot;
+}
+
+void Registry::gaugeCallback(const std::string& name, const std::string& help, std::function<double()> read) {
+    std::lock_guard<std::mutex> lock(mutex);
+    family(name, "gauge", help).callback = std::move(read);
+}
+
+std::string Registry::prometheus() const {
+    // Buckets narrower than this are folded into the first exported one.
+    constexpr uint64_t minExportedMicros = 16;
+
+    std::string out;
+    char buf[64];
+    auto braces = [](const std::string& labels) {
+        return labels.empty() ? std::string() : "{" + labels + "}";
+    };
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& [name, f] : families) {
+        out += "# HELP " + name + " " + f.help + "\n";
+        out += "# TYPE " + name + " " + f.type + "\n";
+        for (const auto& [labels, c] : f.counters) {
+            out += name + braces(labels) + " " + std::to_string(c->value()) + "\n";
+        }
+        for (const auto& [labels, g] : f.gauges) {
+            out += name + braces(labels) + " " + std::to_string(g->value()) + "\n";
+        }
+        if (f.callback) {
+            std::snprintf(buf, sizeof buf, "%.17g", f.callback());
+            out += name + " " + buf + "\n";
+        }
+        for (const auto& [labels, h] : f.histograms) {
+            Histogram::Snapshot snap = h->snapshot();
+            std::string prefix = labels.empty() ? "" : labels + ",";
+            uint64_t cumulative = 0;
+            for (size_t i = 0; i < Histogram::bucketCount; ++i) {
+                cumulative += snap.counts[i];
+                uint64_t bound = Histogram::upperBound(i);
+                if (bound < minExportedMicros) continue;
+                // Durations are truncated to whole microseconds, so every
+                // true duration in the bucket is below its bound.
+                std::snprintf(buf, sizeof buf, "%g", bound / 1e6);
+                out += name + "_bucket{" + prefix + "le=\"" + buf + "\"} " + std::to_string(cumulative) + "\n";
+            }
+            out += name + "_bucket{" + prefix + "le=\"+Inf\"} " + std::to_string(snap.count) + "\n";
+            std::snprintf(buf, sizeof buf, "%.6f", snap.sumMicros / 1e6);
+            out += name + "_sum" + braces(labels) + " " + buf + "\n";
+            out += name + "_count" + braces(labels) + " " + std::to_string(snap.count) + "\n";
+        }
+    }
+    return out;
+}
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+} // namespace metrics
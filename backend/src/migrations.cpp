@@ -0,0 +1,459 @@
+#include "migrations.h"
+#include "tag_index.h"
+#include <string>
+
+namespace {
+
+struct Migration {
+    int version;
+    void (*apply)(SQLite::Database& db);
+};
+
+// For databases created before migrations existed, when columns were
+// bolted on with unconditional ALTER TABLEs.
+void addColumnIfMissing(SQLite::Database& db,
+                        const std::string& table,
+                        const std::string& column,
+                        const std::string& definition) {
+    SQLite::Statement q(db, "SELECT 1 FROM pragma_table_info(?) WHERE name = ?");
+    q.bind(1, table);
+    q.bind(2, column);
+    if (!q.executeStep()) {
+        db.exec("ALTER TABLE " + table + " ADD COLUMN " + column + " " + definition);
+    }
+}
+
+// 1: base schema
+void createBaseSchema(SQLite::Database& db) {
+    // Users table
+    db.exec(R"(
+        CREATE TABLE IF NOT EXISTS users (
+            id INTEGER PRIMARY KEY AUTOINCREMENT,
+            username TEXT UNIQUE,
+            password_hash TEXT
+        )
+    )");
+
+    // Sessions table
+    db.exec(R"(
+        CREATE TABLE IF NOT EXISTS sessions (
+            token TEXT PRIMARY KEY,
+            user_id INTEGER,
+            expires_at TEXT,
+            FOREIGN KEY(user_id) REFERENCES users(id)
+        )
+    )");
+
+    // Books table (per user)
+    db.exec(R"(
+        CREATE TABLE IF NOT EXISTS books (
+            id INTEGER PRIMARY KEY AUTOINCREMENT,
+            user_id INTEGER,
+            title TEXT,
+            author TEXT,
+            genre TEXT,
+            status TEXT,
+            pages_read INTEGER DEFAULT 0,
+            total_pages INTEGER DEFAULT 0,
+            notes TEXT,
+            tags TEXT DEFAULT '',
+            goal_end_date TEXT DEFAULT '',
+            thumbnail TEXT,
+            rating INTEGER DEFAULT 3,
+            FOREIGN KEY(user_id) REFERENCES users(id)
+        )
+    )");
+
+    // Reading sessions table
+    db.exec(R"(
+        CREATE TABLE IF NOT EXISTS reading_sessions (
+            id INTEGER PRIMARY KEY AUTOINCREMENT,
+            user_id INTEGER,
+            book_id INTEGER,
+            start_time TEXT,
+            start_pages_read INTEGER,
+            end_time TEXT,
+            end_pages_read INTEGER,
+            FOREIGN KEY(user_id) REFERENCES users(id),
+            FOREIGN KEY(book_id) REFERENCES books(id)
+        )
+    )");
+
+    // Columns added to books after the first release
+    addColumnIfMissing(db, "books", "user_id",       "INTEGER DEFAULT 0");
+    addColumnIfMissing(db, "books", "pages_read",    "INTEGER DEFAULT 0");
+    addColumnIfMissing(db, "books", "total_pages",   "INTEGER DEFAULT 0");
+    addColumnIfMissing(db, "books", "tags",          "TEXT DEFAULT ''");
+    addColumnIfMissing(db, "books", "goal_end_date", "TEXT DEFAULT ''");
+}
+
+// 2: indexes for the per-user access paths
+void addPerUserIndexes(SQLite::Database& db) {
+    db.exec("CREATE INDEX IF NOT EXISTS idx_books_user ON books(user_id)");
+    // Per-user session listing, already in start order.
+    db.exec("CREATE INDEX IF NOT EXISTS idx_reading_sessions_user "
+            "ON reading_sessions(user_id, start_time)");
+    db.exec("CREATE INDEX IF NOT EXISTS idx_reading_sessions_book "
+            "ON reading_sessions(book_id)");
+    db.exec("CREATE INDEX IF NOT EXISTS idx_sessions_expires ON sessions(expires_at)");
+}
+
+// 3: sort keys and indexes for server-side listing. The generated
+// columns are VIRTUAL, so they cost nothing in the table itself and are
+// materialized only inside the indexes that sort on them.
+void addListingIndexes(SQLite::Database& db) {
+    db.exec("ALTER TABLE books ADD COLUMN title_key TEXT "
+            "GENERATED ALWAYS AS (lower(title)) VIRTUAL");
+    db.exec("ALTER TABLE books ADD COLUMN progress REAL "
+            "GENERATED ALWAYS AS (CASE WHEN total_pages > 0 "
+            "THEN CAST(pages_read AS REAL) / total_pages ELSE 0 END) VIRTUAL");
+
+    db.exec("CREATE INDEX idx_books_status          ON books(user_id, status, id)");
+    db.exec("CREATE INDEX idx_books_title           ON books(user_id, title_key, id)");
+    db.exec("CREATE INDEX idx_books_status_title    ON books(user_id, status, title_key, id)");
+    db.exec("CREATE INDEX idx_books_progress        ON books(user_id, progress, id)");
+    db.exec("CREATE INDEX idx_books_status_progress ON books(user_id, status, progress, id)");
+    db.exec("CREATE INDEX idx_books_rating          ON books(user_id, rating, id)");
+    db.exec("CREATE INDEX idx_books_status_rating   ON books(user_id, status, rating, id)");
+}
+
+// 4: per-user data versions backing ETags
+void addUserVersions(SQLite::Database& db) {
+    db.exec(R"(
+        CREATE TABLE user_versions (
+            user_id INTEGER PRIMARY KEY,
+            version INTEGER NOT NULL DEFAULT 0
+        )
+    )");
+}
+
+// 5: change tracking for delta sync
+void addChangeTracking(SQLite::Database& db) {
+    db.exec("ALTER TABLE books ADD COLUMN updated_version INTEGER NOT NULL DEFAULT 0");
+    db.exec("CREATE INDEX idx_books_updated ON books(user_id, updated_version)");
+    db.exec(R"(
+        CREATE TABLE book_tombstones (
+            user_id INTEGER NOT NULL,
+            book_id INTEGER NOT NULL,
+            version INTEGER NOT NULL,
+            PRIMARY KEY (user_id, book_id)
+        ) WITHOUT ROWID
+    )");
+    db.exec("CREATE INDEX idx_book_tombstones_version ON book_tombstones(user_id, version)");
+
+    // Stamp existing books with a fresh version of their owner so a client
+    // syncing from 0 receives them.
+    db.exec(R"(
+        INSERT INTO user_versions (user_id, version)
+        SELECT DISTINCT user_id, 1 FROM books WHERE true
+        ON CONFLICT(user_id) DO UPDATE SET version = version + 1
+    )");
+    db.exec(R"(
+        UPDATE books SET updated_version =
+            (SELECT version FROM user_versions WHERE user_versions.user_id = books.user_id)
+    )");
+}
+
+// 6: per-user analytics aggregates, seeded from the existing books
+void addAnalytics(SQLite::Database& db) {
+    db.exec(R"(
+        CREATE TABLE user_book_stats (
+            user_id INTEGER PRIMARY KEY,
+            books INTEGER NOT NULL DEFAULT 0,
+            rated_books INTEGER NOT NULL DEFAULT 0,
+            rating_sum INTEGER NOT NULL DEFAULT 0,
+            pages_read INTEGER NOT NULL DEFAULT 0,
+            total_pages INTEGER NOT NULL DEFAULT 0
+        )
+    )");
+    db.exec(R"(
+        CREATE TABLE user_status_counts (
+            user_id INTEGER NOT NULL,
+            status TEXT NOT NULL,
+            count INTEGER NOT NULL,
+            PRIMARY KEY (user_id, status)
+        ) WITHOUT ROWID
+    )");
+    db.exec(R"(
+        CREATE TABLE user_genre_counts (
+            user_id INTEGER NOT NULL,
+            genre TEXT NOT NULL,
+            count INTEGER NOT NULL,
+            PRIMARY KEY (user_id, genre)
+        ) WITHOUT ROWID
+    )");
+
+    db.exec(R"(
+        INSERT INTO user_book_stats
+        SELECT user_id, COUNT(*),
+               SUM(COALESCE(rating, 0) > 0),
+               SUM(MAX(COALESCE(rating, 0), 0)),
+               SUM(COALESCE(pages_read, 0)),
+               SUM(COALESCE(total_pages, 0))
+        FROM books GROUP BY user_id
+    )");
+    db.exec(R"(
+        INSERT INTO user_status_counts
+        SELECT user_id, COALESCE(status, ''), COUNT(*) FROM books GROUP BY 1, 2
+    )");
+    db.exec(R"(
+        INSERT INTO user_genre_counts
+        SELECT user_id, genre, COUNT(*) FROM books WHERE genre <> '' GROUP BY 1, 2
+    )");
+}
+
+// 7: per-day reading rollup, keyed by the day a session started
+void addReadingDaily(SQLite::Database& db) {
+    db.exec(R"(
+        CREATE TABLE reading_daily (
+            user_id INTEGER NOT NULL,
+            day TEXT NOT NULL,
+            pages INTEGER NOT NULL DEFAULT 0,
+            sessions INTEGER NOT NULL DEFAULT 0,
+            seconds INTEGER NOT NULL DEFAULT 0,
+            PRIMARY KEY (user_id, day)
+        ) WITHOUT ROWID
+    )");
+    db.exec(R"(
+        INSERT INTO reading_daily (user_id, day, pages, sessions, seconds)
+        SELECT user_id, substr(start_time, 1, 10),
+               COALESCE(SUM(end_pages_read - start_pages_read), 0), COUNT(*),
+               COALESCE(SUM(CAST(round((julianday(end_time) - julianday(start_time)) * 86400) AS INTEGER)), 0)
+        FROM reading_sessions WHERE end_time IS NOT NULL
+        GROUP BY 1, 2
+    )");
+}
+
+// 8: full-text index over books for library search. External content, so
+// the text is stored once, in books; triggers keep the index in step with
+// every write path.
+void addBookSearch(SQLite::Database& db) {
+    db.exec(R"(
+        CREATE VIRTUAL TABLE books_fts USING fts5(
+            title, author, notes, tags,
+            content = 'books', content_rowid = 'id',
+            tokenize = 'unicode61 remove_diacritics 2',
+            prefix = '2 3'
+        )
+    )");
+    db.exec(R"(
+        CREATE TRIGGER books_fts_insert AFTER INSERT ON books BEGIN
+            INSERT INTO books_fts (rowid, title, author, notes, tags)
+            VALUES (new.id, new.title, new.author, new.notes, new.tags);
+        END
+    )");
+    db.exec(R"(
+        CREATE TRIGGER books_fts_delete AFTER DELETE ON books BEGIN
+            INSERT INTO books_fts (books_fts, rowid, title, author, notes, tags)
+            VALUES ('delete', old.id, old.title, old.author, old.notes, old.tags);
+        END
+    )");
+    // Progress and rating updates rewrite notes and tags unchanged; skip
+    // reindexing unless the text actually differs.
+    db.exec(R"(
+        CREATE TRIGGER books_fts_update AFTER UPDATE OF title, author, notes, tags ON books
+        WHEN old.title IS NOT new.title OR old.author IS NOT new.author
+          OR old.notes IS NOT new.notes OR old.tags IS NOT new.tags
+        BEGIN
+            INSERT INTO books_fts (books_fts, rowid, title, author, notes, tags)
+            VALUES ('delete', old.id, old.title, old.author, old.notes, old.tags);
+            INSERT INTO books_fts (rowid, title, author, notes, tags)
+            VALUES (new.id, new.title, new.author, new.notes, new.tags);
+        END
+    )");
+    db.exec("INSERT INTO books_fts (books_fts) VALUES ('rebuild')");
+}
+
+// 9: tags interned into a dictionary with a per-book join table. books.tags
+// stays as the text the client sent, for round-tripping.
+void addTagTables(SQLite::Database& db) {
+    db.exec(R"(
+        CREATE TABLE tags (
+            id INTEGER PRIMARY KEY,
+            name TEXT NOT NULL UNIQUE
+        )
+    )");
+    db.exec(R"(
+        CREATE TABLE book_tags (
+            book_id INTEGER NOT NULL,
+            tag_id INTEGER NOT NULL,
+            user_id INTEGER NOT NULL,
+            PRIMARY KEY (book_id, tag_id)
+        ) WITHOUT ROWID
+    )");
+    db.exec("CREATE INDEX idx_book_tags_user_tag ON book_tags(user_id, tag_id, book_id)");
+
+    SQLite::Statement books(db, "SELECT id, user_id, tags FROM books WHERE tags <> ''");
+    SQLite::Statement intern(db, "INSERT OR IGNORE INTO tags (name) VALUES (?)");
+    SQLite::Statement link(db, R"(
+        INSERT OR IGNORE INTO book_tags (book_id, tag_id, user_id)
+        SELECT ?, id, ? FROM tags WHERE name = ?
+    )");
+    while (books.executeStep()) {
+        for (const std::string& tag : splitTags(books.getColumn(2).getString())) {
+            intern.bind(1, tag);
+            intern.exec();
+            intern.reset();
+            link.bind(1, books.getColumn(0).getInt64());
+            link.bind(2, books.getColumn(1).getInt());
+            link.bind(3, tag);
+            link.exec();
+            link.reset();
+        }
+    }
+}
+
+// 10: users and login sessions live in the directory database (see
+// Database); a shard keeps only per-user library data. A shard adopted
+// from the old single-file layout had its users copied out first.
+void dropDirectoryTables(SQLite::Database& db) {
+    db.exec("DROP TABLE IF EXISTS sessions");
+    db.exec("DROP TABLE IF EXISTS users");
+}
+
+// 11: the search index leads with an owner column holding one token per
+// user ("u<id>"), so a search MATCHes the user's token and FTS5 walks that
+// user's postings instead of every match on the shard. books has no owner
+// column, so the index reads its content through a view.
+void addSearchOwner(SQLite::Database& db) {
+    db.exec("DROP TRIGGER books_fts_insert");
+    db.exec("DROP TRIGGER books_fts_delete");
+    db.exec("DROP TRIGGER books_fts_update");
+    db.exec("DROP TABLE books_fts");
+    db.exec(R"(
+        CREATE VIEW books_search AS
+        SELECT id, 'u' || user_id AS owner, title, author, notes, tags FROM books
+    )");
+    db.exec(R"(
+        CREATE VIRTUAL TABLE books_fts USING fts5(
+            owner, title, author, notes, tags,
+            content = 'books_search', content_rowid = 'id',
+            tokenize = 'unicode61 remove_diacritics 2',
+            prefix = '2 3'
+        )
+    )");
+    db.exec(R"(
+        CREATE TRIGGER books_fts_insert AFTER INSERT ON books BEGIN
+            INSERT INTO books_fts (rowid, owner, title, author, notes, tags)
+            VALUES (new.id, 'u' || new.user_id, new.title, new.author, new.notes, new.tags);
+        END
+    )");
+    db.exec(R"(
+        CREATE TRIGGER books_fts_delete AFTER DELETE ON books BEGIN
+            INSERT INTO books_fts (books_fts, rowid, owner, title, author, notes, tags)
+            VALUES ('delete', old.id, 'u' || old.user_id, old.title, old.author, old.notes, old.tags);
+        END
+    )");
+    db.exec(R"(
+        CREATE TRIGGER books_fts_update AFTER UPDATE OF user_id, title, author, notes, tags ON books
+        WHEN old.user_id IS NOT new.user_id
+          OR old.title IS NOT new.title OR old.author IS NOT new.author
+          OR old.notes IS NOT new.notes OR old.tags IS NOT new.tags
+        BEGIN
+            INSERT INTO books_fts (books_fts, rowid, owner, title, author, notes, tags)
+            VALUES ('delete', old.id, 'u' || old.user_id, old.title, old.author, old.notes, old.tags);
+            INSERT INTO books_fts (rowid, owner, title, author, notes, tags)
+            VALUES (new.id, 'u' || new.user_id, new.title, new.author, new.notes, new.tags);
+        END
+    )");
+    db.exec("INSERT INTO books_fts (books_fts) VALUES ('rebuild')");
+}
+
+// 12: tombstones are pruned after a retention period (see Shard). Each
+// records when it was written, existing ones as of the upgrade, and
+// user_versions keeps the newest version pruned per user.
+void addTombstoneRetention(SQLite::Database& db) {
+    db.exec("ALTER TABLE book_tombstones ADD COLUMN deleted_at INTEGER NOT NULL DEFAULT 0");
+    db.exec("UPDATE book_tombstones SET deleted_at = CAST(strftime('%s', 'now') AS INTEGER)");
+    db.exec("CREATE INDEX idx_book_tombstones_deleted ON book_tombstones(user_id, deleted_at)");
+    db.exec("ALTER TABLE user_versions ADD COLUMN pruned_version INTEGER NOT NULL DEFAULT 0");
+}
+
+// Append only: never renumber or edit a migration that has shipped.
+const Migration migrations[] = {
+    {1, createBaseSchema},
+    {2, addPerUserIndexes},
+    {3, addListingIndexes},
+    {4, addUserVersions},
+    {5, addChangeTracking},
+    {6, addAnalytics},
+    {7, addReadingDaily},
+    {8, addBookSearch},
+    {9, addTagTables},
+    {10, dropDirectoryTables},
+    {11, addSearchOwner},
+    {12, addTombstoneRetention},
+};
+
+// Directory database: accounts, login sessions, shard placement and the
+// id sequences shared by all shards.
+void createDirectorySchema(SQLite::Database& db) {
+    // shard: where the user's library lives; fixed at signup, changed only
+    // by Database::moveUser
+    db.exec(R"(
+        CREATE TABLE users (
+            id INTEGER PRIMARY KEY AUTOINCREMENT,
+            username TEXT UNIQUE,
+            password_hash TEXT,
+            shard INTEGER NOT NULL DEFAULT 0
+        )
+    )");
+    db.exec(R"(
+        CREATE TABLE sessions (
+            token TEXT PRIMARY KEY,
+            user_id INTEGER,
+            expires_at TEXT
+        )
+    )");
+    db.exec("CREATE INDEX idx_sessions_expires ON sessions(expires_at)");
+    // Next unused id per shard-resident table, so rows keep their ids
+    // when a user moves between shards
+    db.exec(R"(
+        CREATE TABLE id_sequences (
+            name TEXT PRIMARY KEY,
+            next INTEGER NOT NULL
+        ) WITHOUT ROWID
+    )");
+    db.exec("INSERT INTO id_sequences (name, next) VALUES ('books', 1), ('reading_sessions', 1)");
+}
+
+const Migration directoryMigrations[] = {
+    {1, createDirectorySchema},
+};
+
+int userVersion(SQLite::Database& db) {
+    SQLite::Statement q(db, "PRAGMA user_version");
+    q.executeStep();
+    return q.getColumn(0).getInt();
+}
+
+void run(SQLite::Database& db, const Migration* begin, const Migration* end) {
+    if (userVersion(db) >= end[-1].version) return;
+
+    for (const Migration* m = begin; m != end; ++m) {
+        // IMMEDIATE takes the write lock before the version is read, so two
+        // processes cannot both see the old version and apply the step
+        // twice; a deferred read would only fail at the first write.
+        SQLite::Transaction tx(db, SQLite::TransactionBehavior::IMMEDIATE);
+        // Re-checked inside the transaction in case another process
+        // migrated the file first.
+        if (userVersion(db) >= m->version) continue;
+        m->apply(db);
+        db.exec("PRAGMA user_version = " + std::to_string(m->version));
+        tx.commit();
+    }
+}
+
+} // namespace
+
+int latestSchemaVersion() {
+    return std::end(migrations)[-1].version;
+}
+
+void migrate(SQLite::Database& db) {
+    run(db, std::begin(migrations), std::end(migrations));
+}
+
+void migrateDirectory(SQLite::Database& db) {
+    run(db, std::begin(directoryMigrations), std::end(directoryMigrations));
+}
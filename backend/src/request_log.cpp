@@ -0,0 +1,177 @@
+#include "request_log.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+
+namespace {
+
+std::atomic<uint64_t> nextInstance{1};
+
+void appendEscaped(std::string& out, const char* text, size_t size) {
+    static const char hex[] = "0123456789abcdef";
+    for (size_t i = 0; i < size; ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += static_cast<char>(c);
+        } else if (c < 0x20) {
+            out += "\\u00";
+            out += hex[c >> 4];
+            out += hex[c & 0xF];
+        } else {
+            out += static_cast<char>(c);
+        }
+    }
+}
+
+// 2024-01-31T12:34:56.789Z
+void appendTime(std::string& out, int64_t timeUs) {
+    std::time_t seconds = static_cast<std::time_t>(timeUs / 1000000);
+    std::tm tm{};
+    gmtime_r(&seconds, &tm);
+    char buf[32];
+    size_t n = std::strftime(buf, sizeof buf, "%Y-%m-%dT%H:%M:%S", &tm);
+    n += std::snprintf(buf + n, sizeof buf - n, ".%03dZ", static_cast<int>(timeUs / 1000 % 1000));
+    out.append(buf, n);
+}
+
+} // namespace
+
+RequestLog::RequestLog(std::string path, size_t maxFileBytes, int keepFiles)
+    : instance(nextInstance.fetch_add(1)), path(std::move(path)), maxFileBytes(maxFileBytes), keepFiles(keepFiles) {
+    if (this->path.empty()) {
+        out = stdout;
+    } else {
+        out = std::fopen(this->path.c_str(), "a");
+        if (!out) {
+            std::cerr << "cannot open request log " << this->path << "; using stdout\n";
+            out = stdout;
+            this->path.clear();
+        } else {
+            std::fseek(out, 0, SEEK_END);
+            fileBytes = static_cast<size_t>(std::ftell(out));
+        }
+    }
+    drainer = std::thread([this] { run(); });
+}
+
+RequestLog::~RequestLog() {
+    {
+        std::lock_guard<std::mutex> lock(stopMutex);
+        stopping = true;
+    }
+    stopSignal.notify_one();
+    drainer.join();
+    if (out && out != stdout) std::fclose(out);
+}
+
+RequestLog::Ring& RequestLog::threadRing() {
+    // One ring per (thread, log); the log outlives the server's workers.
+    thread_local uint64_t owner = 0;
+    thread_local Ring* ring = nullptr;
+    if (owner != instance) {
+        auto fresh = std::make_unique<Ring>();
+        ring = fresh.get();
+        owner = instance;
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        rings.push_back(std::move(fresh));
+    }
+    return *ring;
+}
+
+void RequestLog::log(std::string_view method, std::string_view path, int status,
+                     uint32_t latencyUs, uint64_t bytes, int userId) {
+    Ring& ring = threadRing();
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    if (head - ring.tail.load(std::memory_order_acquire) == ringSize) {
+        droppedTotal.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Record& r = ring.records[head & (ringSize - 1)];
+    r.timeUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    r.latencyUs = latencyUs;
+    r.bytes = static_cast<uint32_t>(std::min<uint64_t>(bytes, UINT32_MAX));
+    r.userId = userId;
+    r.status = static_cast<uint16_t>(status);
+    r.methodLen = static_cast<uint8_t>(std::min(method.size(), sizeof r.method));
+    std::memcpy(r.method, method.data(), r.methodLen);
+    r.pathLen = static_cast<uint8_t>(std::min(path.size(), sizeof r.path));
+    std::memcpy(r.path, path.data(), r.pathLen);
+
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+void RequestLog::run() {
+    std::unique_lock<std::mutex> lock(stopMutex);
+    while (!stopping) {
+        stopSignal.wait_for(lock, flushInterval, [&] { return stopping; });
+        lock.unlock();
+        drain();
+        lock.lock();
+    }
+}
+
+void RequestLog::drain() {
+    std::vector<Ring*> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        for (auto& ring : rings) snapshot.push_back(ring.get());
+    }
+
+    std::string batch;
+    for (Ring* ring : snapshot) {
+        uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        for (; tail != head; ++tail) {
+            const Record& r = ring->records[tail & (ringSize - 1)];
+            batch += "{\"time\":\"";
+            appendTime(batch, r.timeUs);
+            batch += "\",\"method\":\"";
+            appendEscaped(batch, r.method, r.methodLen);
+            batch += "\",\"path\":\"";
+            appendEscaped(batch, r.path, r.pathLen);
+            batch += "\",\"status\":" + std::to_string(r.status);
+            batch += ",\"latencyUs\":" + std::to_string(r.latencyUs);
+            batch += ",\"bytes\":" + std::to_string(r.bytes);
+            batch += ",\"userId\":" + std::to_string(r.userId);
+            batch += "}\n";
+        }
+        ring->tail.store(tail, std::memory_order_release);
+    }
+
+    uint64_t dropped = droppedTotal.load(std::memory_order_relaxed);
+    if (dropped != droppedReported) {
+        batch += "{\"event\":\"dropped\",\"count\":" + std::to_string(dropped - droppedReported) + "}\n";
+        droppedReported = dropped;
+    }
+    if (!batch.empty()) write(batch);
+}
+
+void RequestLog::write(const std::string& batch) {
+    std::fwrite(batch.data(), 1, batch.size(), out);
+    std::fflush(out);
+    fileBytes += batch.size();
+    if (!path.empty() && fileBytes >= maxFileBytes) rotate();
+}
+
+void RequestLog::rotate() {
+    std::fclose(out);
+    // path.<keep> falls off the end; the rest shift up by one.
+    for (int i = keepFiles - 1; i >= 1; --i) {
+        std::rename((path + "." + std::to_string(i)).c_str(),
+                    (path + "." + std::to_string(i + 1)).c_str());
+    }
+    if (keepFiles > 0) std::rename(path.c_str(), (path + ".1").c_str());
+    else               std::remove(path.c_str());
+    out = std::fopen(path.c_str(), "w");
+    if (!out) {
+        std::cerr << "cannot reopen request log " << path << "; using stdout\n";
+        out = stdout;
+        path.clear();
+    }
+    fileBytes = 0;
+}
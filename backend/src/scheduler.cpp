@@ -0,0 +1,113 @@
+#include "scheduler.h"
+#include "metrics.h"
+#include <cstdlib>
+#include <sstream>
+
+namespace {
+
+std::string poolLabel(RequestClass c) {
+    return std::string("pool=\"") + requestClassName(c) + "\"";
+}
+
+} // namespace
+
+const char* requestClassName(RequestClass c) {
+    switch (c) {
+    case RequestClass::Auth:     return "auth";
+    case RequestClass::Read:     return "read";
+    case RequestClass::Write:    return "write";
+    case RequestClass::External: return "external";
+    }
+    return "unknown";
+}
+
+RequestPool::RequestPool(RequestClass requestClass, Options options)
+    : opts(options),
+      activeGauge(metrics::registry().gauge("booktracker_pool_active",
+          "Requests holding a slot in their pool", poolLabel(requestClass))),
+      queuedGauge(metrics::registry().gauge("booktracker_pool_queued",
+          "Requests waiting for a slot in their pool", poolLabel(requestClass))),
+      admitted(metrics::registry().counter("booktracker_pool_admitted_total",
+          "Requests given a slot", poolLabel(requestClass))),
+      rejectedFull(metrics::registry().counter("booktracker_pool_rejected_total",
+          "Requests turned away with 503", poolLabel(requestClass) + ",reason=\"queue_full\"")),
+      rejectedTimeout(metrics::registry().counter("booktracker_pool_rejected_total",
+          "Requests turned away with 503", poolLabel(requestClass) + ",reason=\"queue_timeout\"")),
+      queueWait(metrics::registry().histogram("booktracker_pool_queue_wait_seconds",
+          "Time requests waited for a slot", poolLabel(requestClass))) {}
+
+std::shared_ptr<RequestPool::Permit> RequestPool::admit() {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (active < opts.concurrency) {
+        ++active;
+    } else if (queued >= opts.queueDepth) {
+        lock.unlock();
+        rejectedFull.add();
+        return nullptr;
+    } else {
+        ++queued;
+        queuedGauge.add(1);
+        auto start = std::chrono::steady_clock::now();
+        bool got = slotFree.wait_for(lock, opts.queueTimeout, [&] { return active < opts.concurrency; });
+        --queued;
+        queuedGauge.add(-1);
+        queueWait.record(std::chrono::steady_clock::now() - start);
+        if (!got) {
+            lock.unlock();
+            rejectedTimeout.add();
+            return nullptr;
+        }
+        ++active;
+    }
+    lock.unlock();
+    activeGauge.add(1);
+    admitted.add();
+    return std::make_shared<Permit>(*this);
+}
+
+void RequestPool::release() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        --active;
+    }
+    activeGauge.add(-1);
+    slotFree.notify_one();
+}
+
+bool Scheduler::parse(const std::string& spec, Options& options) {
+    std::istringstream ss(spec);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (item.empty()) continue;
+        size_t eq = item.find('=');
+        size_t colon = item.find(':', eq);
+        if (eq == std::string::npos || colon == std::string::npos) return false;
+        std::string name = item.substr(0, eq);
+        size_t c = 0;
+        while (c < requestClassCount && name != requestClassName(static_cast<RequestClass>(c))) ++c;
+        if (c == requestClassCount) return false;
+
+        char* end = nullptr;
+        long concurrency = std::strtol(item.c_str() + eq + 1, &end, 10);
+        if (end != item.c_str() + colon || concurrency < 1) return false;
+        long depth = std::strtol(item.c_str() + colon + 1, &end, 10);
+        if (*end != '\0' || depth < 0) return false;
+        options.pools[c].concurrency = static_cast<size_t>(concurrency);
+        options.pools[c].queueDepth = static_cast<size_t>(depth);
+    }
+    return true;
+}
+
+Scheduler::Scheduler() : Scheduler(Options()) {}
+
+Scheduler::Scheduler(const Options& options) {
+    for (size_t c = 0; c < requestClassCount; ++c) {
+        pools[c] = std::make_unique<RequestPool>(static_cast<RequestClass>(c), options.pools[c]);
+    }
+}
+
+size_t Scheduler::threadBudget() const {
+    size_t total = 0;
+    for (const auto& pool : pools) total += pool->options().concurrency + pool->options().queueDepth;
+    return total;
+}
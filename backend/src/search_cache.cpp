@@ -0,0 +1,42 @@
+#include "search_cache.h"
+#include <algorithm>
+#include <functional>
+
+SearchCache::SearchCache(size_t capacity, Clock::duration ttl)
+    : shardCapacity(std::max<size_t>(1, capacity / shardCount)), ttl(ttl) {}
+
+SearchCache::Shard& SearchCache::shardFor(const std::string& key) {
+    return shards[std::hash<std::string>{}(key) % shardCount];
+}
+
+SearchCache::Body SearchCache::get(const std::string& key) {
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it == shard.index.end()) return nullptr;
+    if (it->second->expiresAt <= Clock::now()) {
+        shard.lru.erase(it->second);
+        shard.index.erase(it);
+        return nullptr;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    return it->second->body;
+}
+
+void SearchCache::put(const std::string& key, Body body) {
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        it->second->body = std::move(body);
+        it->second->expiresAt = Clock::now() + ttl;
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return;
+    }
+    shard.lru.push_front(Entry{key, std::move(body), Clock::now() + ttl});
+    shard.index.emplace(key, shard.lru.begin());
+    if (shard.lru.size() > shardCapacity) {
+        shard.index.erase(shard.lru.back().key);
+        shard.lru.pop_back();
+    }
+}
@@ -0,0 +1,966 @@
+#include "server.h"
+#include "book_import.h"
+#include "book_input.h"
+#include "compression.h"
+#include "cover_store.h"
+#include "metrics.h"
+#include "scheduler.h"
+#include <nlohmann/json.hpp>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <iomanip>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <climits>
+#include <chrono>
+#include <ctime>
+#include <memory>
+#include <optional>
+#include <string_view>
+
+// — Helpers —
+
+// Make a random hex token
+static std::string makeToken(int len = 32) {
+    static std::mt19937_64 rng{std::random_device{}()};
+    static std::uniform_int_distribution<uint64_t> dist;
+    std::ostringstream ss;
+    while ((int)ss.str().size() < len) ss << std::hex << dist(rng);
+    return ss.str().substr(0, len);
+}
+
+// ISO now
+static std::string nowISO() {
+    std::time_t t = std::time(nullptr);
+    std::ostringstream ss;
+    ss << std::put_time(std::gmtime(&t), "%Y-%m-%dT%H:%M:%SZ");
+    return ss.str();
+}
+
+// ISO N days in the future
+static std::string futureISO(int days) {
+    std::time_t t = std::time(nullptr) + days * 24 * 3600;
+    std::ostringstream ss;
+    ss << std::put_time(std::gmtime(&t), "%Y-%m-%dT%H:%M:%SZ");
+    return ss.str();
+}
+
+// YYYY-MM-DD, digits only checked; the database compares days as text.
+static bool isDay(const std::string& s) {
+    if (s.size() != 10 || s[4] != '-' || s[7] != '-') return false;
+    for (size_t i : {0, 1, 2, 3, 5, 6, 8, 9}) {
+        if (!std::isdigit(static_cast<unsigned char>(s[i]))) return false;
+    }
+    return true;
+}
+
+// Per-request state for the access log. A request is handled start to
+// finish on one worker thread, streamed body included.
+static thread_local std::chrono::steady_clock::time_point requestStart;
+static thread_local int requestUser = 0;
+static thread_local uint64_t streamedBytes = 0;
+// Content-Encoding negotiated for this request's API response
+static thread_local Coding requestCoding = Coding::Identity;
+
+// httplib holds a server thread for the whole life of a connection, idle
+// keep-alive time included, and admission control only runs once a thread
+// reads a request. So: threads beyond the pools' budget for idle
+// connections; idle connections closed after a few seconds and recycled
+// after a number of requests; and a bound on accepted connections waiting
+// for a thread, past which httplib closes new ones instead of queueing
+// them. With every thread held, a new connection waits at most about
+// keepAliveSeconds for one.
+static constexpr size_t keepAliveThreads = 16;
+static constexpr time_t keepAliveSeconds = 2;
+static constexpr size_t keepAliveMaxRequests = 100;
+static constexpr size_t maxQueuedConnections = 64;
+
+// Buffered responses smaller than this go out uncompressed; the framing
+// would eat most of the saving.
+static constexpr size_t minCompressBytes = 1024;
+
+// Latency and responses by status class for one registered route.
+struct RouteMetrics {
+    metrics::Histogram* latency;
+    std::array<metrics::Counter*, 5> responses;     // 1xx .. 5xx
+};
+
+static RouteMetrics routeMetrics(const std::string& route) {
+    auto& registry = metrics::registry();
+    std::string label = "route=\"" + route + "\"";
+    RouteMetrics m;
+    m.latency = &registry.histogram("booktracker_http_request_duration_seconds",
+                                    "Request latency by route, streamed body included", label);
+    for (int i = 0; i < 5; ++i) {
+        m.responses[i] = &registry.counter("booktracker_http_responses_total", "Responses by route and status class",
+                                           label + ",code=\"" + std::to_string(i + 1) + "xx\"");
+    }
+    return m;
+}
+
+// Route the current request matched; the logger records against it.
+static thread_local const RouteMetrics* requestRoute = nullptr;
+static thread_local bool requestInFlight = false;
+
+// Slot this request holds in its pool. Content providers capture it, so
+// the slot stays taken until the last byte of a streamed body is sent.
+static thread_local std::shared_ptr<RequestPool::Permit> requestPermit;
+
+static void serverBusy(httplib::Response& res) {
+    res.status = 503;
+    res.set_header("Retry-After", "1");
+    res.set_content(R"({"error":"Server busy, retry shortly"})","application/json");
+}
+
+// Admits a request to pool, or answers 503 when the pool is saturated.
+static bool admit(RequestPool& pool, httplib::Response& res) {
+    requestPermit = pool.admit();
+    if (requestPermit) return true;
+    serverBusy(res);
+    return false;
+}
+
+// Drops the handler's reference to its permit, however it exits.
+struct PermitScope {
+    ~PermitScope() { requestPermit.reset(); }
+};
+
+// Some of the user's acknowledged book updates could not be saved (see
+// WriteBehindQueue). The client should reload those books and resend.
+static void updateLost(httplib::Response& res, const WriteBehindQueue::UpdateLost& e) {
+    res.status = 409;
+    res.set_content(nlohmann::json{{"error", "Update lost: earlier changes to these books were not saved"},
+                                   {"lostBooks", e.bookIds}}.dump(),
+                    "application/json");
+}
+
+// Wraps a handler so it runs under pool's admission control and its
+// requests are recorded under name.
+template <typename Handler>
+static httplib::Server::Handler route(const char* name, RequestPool& pool, Handler handler) {
+    auto m = std::make_shared<const RouteMetrics>(routeMetrics(name));
+    return [m, &pool, handler](const httplib::Request& req, httplib::Response& res) {
+        requestRoute = m.get();
+        PermitScope scope;
+        if (!admit(pool, res)) return;
+        try {
+            handler(req, res);
+        } catch (const WriteBehindQueue::UpdateLost& e) {
+            updateLost(res, e);
+        } catch (const ConnectionPool::Busy&) {
+            serverBusy(res);
+        }
+    };
+}
+
+template <typename Handler>
+static httplib::Server::HandlerWithContentReader routeWithReader(const char* name, RequestPool& pool,
+                                                                 Handler handler) {
+    auto m = std::make_shared<const RouteMetrics>(routeMetrics(name));
+    return [m, &pool, handler](const httplib::Request& req, httplib::Response& res,
+                               const httplib::ContentReader& reader) {
+        requestRoute = m.get();
+        PermitScope scope;
+        if (!admit(pool, res)) return;
+        try {
+            handler(req, res, reader);
+        } catch (const WriteBehindQueue::UpdateLost& e) {
+            updateLost(res, e);
+        } catch (const ConnectionPool::Busy&) {
+            serverBusy(res);
+        }
+    };
+}
+
+// Sends the JSON that fn writes to its sink with chunked encoding, as the
+// client reads it.
+template <typename Fn>
+static void streamJson(httplib::Response& res, const char* what, Fn fn) {
+    // Compressed as it streams, since the final size is unknown up front.
+    Coding coding = requestCoding;
+    if (coding != Coding::Identity) {
+        res.set_header("Content-Encoding", codingName(coding));
+        if (!res.has_header("Vary")) res.set_header("Vary", "Accept-Encoding");
+    }
+    res.set_chunked_content_provider("application/json",
+        [what, fn, coding, permit = requestPermit](size_t, httplib::DataSink& sink) {
+            JsonWriter::Sink send = [&](const char* data, size_t size) {
+                streamedBytes += size;
+                return sink.write(data, size);
+            };
+            try {
+                if (coding == Coding::Identity) {
+                    if (!fn(send)) return false;
+                } else {
+                    Compressor& compressor = Compressor::local(coding);
+                    compressor.reset();
+                    if (!fn([&](const char* data, size_t size) {
+                            return compressor.write(data, size, false, send);
+                        })) return false;
+                    if (!compressor.write(nullptr, 0, true, send)) return false;
+                }
+            } catch (const std::exception& e) {
+                std::cerr << what << " failed: " << e.what() << "\n";
+                return false;
+            }
+            sink.done();
+            return true;
+        });
+}
+
+// An id matched by (\d+), or nullopt if it does not fit an int.
+static std::optional<int> parseId(const std::string& digits) {
+    int id;
+    auto [end, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), id);
+    if (ec != std::errc() || end != digits.data() + digits.size()) return std::nullopt;
+    return id;
+}
+
+// Reads the optional integer field key of a JSON object body into out,
+// leaving out as it is when the field is absent. Returns false if the
+// field is not an integer from min to INT_MAX.
+static bool intField(const nlohmann::json& body, const char* key, int min, int& out) {
+    auto it = body.find(key);
+    if (it == body.end()) return true;
+    if (!it->is_number_integer()) return false;
+    if (it->is_number_unsigned() && it->get<uint64_t>() > INT_MAX) return false;
+    int64_t value = it->get<int64_t>();
+    if (value < min || value > INT_MAX) return false;
+    out = static_cast<int>(value);
+    return true;
+}
+
+// ETag of a user's library at its current version. Streamed bodies are
+// always sent in the negotiated coding, so each coding gets its own strong
+// tag (as StaticAsset::etag does). Buffered bodies may or may not be
+// compressed, depending on their size, so they get a weak tag instead.
+static std::string libraryEtag(int uid, int64_t version, bool streamed) {
+    std::string tag = std::to_string(uid) + "-" + std::to_string(version);
+    if (!streamed) return "W/\"" + tag + "\"";
+    if (requestCoding != Coding::Identity) tag += std::string("-") + codingName(requestCoding);
+    return "\"" + tag + "\"";
+}
+
+// Does If-None-Match list this ETag? Uses the weak comparison RFC 9110
+// prescribes for If-None-Match, so W/ prefixes are ignored.
+static bool etagMatches(const httplib::Request& req, std::string_view etag) {
+    if (etag.rfind("W/", 0) == 0) etag.remove_prefix(2);
+    auto header = req.get_header_value("If-None-Match");
+    if (header.empty()) return false;
+    std::istringstream ss(header);
+    std::string candidate;
+    while (std::getline(ss, candidate, ',')) {
+        auto begin = candidate.find_first_not_of(' ');
+        auto end   = candidate.find_last_not_of(' ');
+        if (begin == std::string::npos) continue;
+        candidate = candidate.substr(begin, end - begin + 1);
+        if (candidate == "*") return true;
+        if (candidate.rfind("W/", 0) == 0) candidate.erase(0, 2);
+        if (candidate == etag) return true;
+    }
+    return false;
+}
+
+// Reads a book body for POST or PUT /api/books. Answers 400 and returns
+// false if it is malformed or breaks the field rules; book's text views
+// req.body and the parser.
+static bool readBook(const httplib::Request& req, httplib::Response& res,
+                     BookInputParser& parser, BookInput& book, bool isNew) {
+    const char* problem = nullptr;
+    if (!parser.parse(req.body, book)) problem = parser.error().c_str();
+    else problem = checkBook(book, isNew);
+    if (!problem) return true;
+    res.status = 400;
+    res.set_content(nlohmann::json{{"error", problem}}.dump(),"application/json");
+    return false;
+}
+
+// Parse /api/books listing parameters: status, sort, dir, limit, cursor
+static bool parseBookQuery(const httplib::Request& req, BookQuery& q) {
+    q.status = req.get_param_value("status");
+
+    auto sort = req.get_param_value("sort");
+    if (sort.empty() || sort == "id")  q.sort = BookQuery::Sort::Id;
+    else if (sort == "title")          q.sort = BookQuery::Sort::Title;
+    else if (sort == "progress")       q.sort = BookQuery::Sort::Progress;
+    else if (sort == "rating")         q.sort = BookQuery::Sort::Rating;
+    else return false;
+
+    auto dir = req.get_param_value("dir");
+    if (dir == "desc")                     q.descending = true;
+    else if (!dir.empty() && dir != "asc") return false;
+
+    if (req.has_param("limit")) {
+        try { q.limit = std::stoi(req.get_param_value("limit")); }
+        catch (...) { return false; }
+        if (q.limit < 1 || q.limit > 500) return false;
+    }
+
+    // tags=a,b matches books with every tag; tagMatch=any with either
+    q.tags = splitTags(req.get_param_value("tags"));
+    auto tagMatch = req.get_param_value("tagMatch");
+    if (tagMatch == "any")                           q.anyTag = true;
+    else if (!tagMatch.empty() && tagMatch != "all") return false;
+
+    auto cursor = req.get_param_value("cursor");
+    if (!cursor.empty() && (q.limit == 0 || !q.setCursor(cursor))) return false;
+    return true;
+}
+
+// CORS: echo origin + allow credentials
+static void enableCORS(const httplib::Request& req, httplib::Response& res) {
+    auto origin = req.get_header_value("Origin");
+    res.set_header("Access-Control-Allow-Origin",
+                   origin.empty() ? "*" : origin);
+    res.set_header("Access-Control-Allow-Credentials", "true");
+    res.set_header("Access-Control-Allow-Methods", "GET, POST, PUT, DELETE, OPTIONS");
+    res.set_header("Access-Control-Allow-Headers", "Content-Type");
+}
+
+// Parse our session cookie
+static std::optional<std::string> getSessionToken(const httplib::Request& req) {
+    auto it = req.headers.find("Cookie");
+    if (it == req.headers.end()) return std::nullopt;
+    std::istringstream ss(it->second);
+    std::string kv;
+    while (std::getline(ss, kv, ';')) {
+        auto pos = kv.find('=');
+        if (pos == std::string::npos) continue;
+        std::string k = kv.substr(0, pos),
+                    v = kv.substr(pos+1);
+        while (!k.empty() && k.front()==' ') k.erase(k.begin());
+        if (k == "session") return v;
+    }
+    return std::nullopt;
+}
+
+// Set/Clear cookie
+static void setCookie(httplib::Response& res, const std::string& token) {
+    res.set_header("Set-Cookie",
+        "session=" + token +
+        "; HttpOnly; Path=/; Max-Age=" + std::to_string(7*24*3600));
+}
+static void clearCookie(httplib::Response& res) {
+    res.set_header("Set-Cookie",
+                   "session=; HttpOnly; Path=/; Max-Age=0");
+}
+
+// Auth guard: the session's user id, or -1 after answering 401
+static int requireUser(Database& db, const httplib::Request& req, httplib::Response& res) {
+    enableCORS(req, res);
+    if (auto tok = getSessionToken(req)) {
+        if (auto uid = db.getUserIdBySession(*tok)) return requestUser = *uid;
+    }
+    res.status = 401;
+    res.set_content(R"({"error":"Unauthorized"})","application/json");
+    return -1;
+}
+
+// — Routes —
+
+void registerRoutes(httplib::Server& svr, Database& db, GoogleBooksAPI& api, RequestLog& requestLog,
+                    Scheduler& scheduler, CoverStore& covers) {
+    // 0) Every route runs in one of four pools (see Scheduler). httplib's
+    // connection threads are sized so that all pools can be full at once,
+    // plus headroom for idle keep-alive connections.
+    RequestPool& auth     = scheduler.pool(RequestClass::Auth);
+    RequestPool& reads    = scheduler.pool(RequestClass::Read);
+    RequestPool& writes   = scheduler.pool(RequestClass::Write);
+    RequestPool& external = scheduler.pool(RequestClass::External);
+    size_t threads = scheduler.threadBudget() + keepAliveThreads;
+    svr.new_task_queue = [threads] { return new httplib::ThreadPool(threads, maxQueuedConnections); };
+    svr.set_keep_alive_timeout(keepAliveSeconds);
+    svr.set_keep_alive_max_count(keepAliveMaxRequests);
+
+    // 1) Log every request and feed the /api/metrics latency histograms.
+    // Requests no route claimed (static files, 404s) are recorded under
+    // "other".
+    static const RouteMetrics otherRoute = routeMetrics("other");
+    metrics::Gauge* inFlight = &metrics::registry().gauge(
+        "booktracker_http_requests_in_flight", "Requests being handled or streamed");
+    metrics::registry().gaugeCallback("booktracker_log_dropped_records",
+        "Access log records dropped because a thread's buffer was full",
+        [&requestLog] { return double(requestLog.dropped()); });
+    svr.set_pre_routing_handler([inFlight](const httplib::Request& req, httplib::Response&) {
+        requestStart = std::chrono::steady_clock::now();
+        requestUser = 0;
+        streamedBytes = 0;
+        requestRoute = &otherRoute;
+        requestCoding = req.path.rfind("/api/", 0) == 0
+            ? negotiateCoding(req.get_header_value("Accept-Encoding")) : Coding::Identity;
+        // Still set if the thread's last request never reached the logger
+        // (e.g. the client hung up mid-stream); it was already counted.
+        if (!requestInFlight) inFlight->add(1);
+        requestInFlight = true;
+        return httplib::Server::HandlerResponse::Unhandled;
+    });
+    svr.set_logger([&requestLog, inFlight](const httplib::Request& req, const httplib::Response& res) {
+        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - requestStart).count();
+        uint64_t bytes = res.body.empty() ? streamedBytes : res.body.size();
+        requestLog.log(req.method, req.path, res.status, static_cast<uint32_t>(latency), bytes, requestUser);
+
+        if (requestInFlight) {
+            inFlight->add(-1);
+            requestInFlight = false;
+            requestRoute->latency->recordMicros(static_cast<uint64_t>(latency));
+            int statusClass = res.status / 100 - 1;
+            if (statusClass >= 0 && statusClass < 5) requestRoute->responses[statusClass]->add();
+        }
+    });
+
+    // 2) Compress buffered API responses the client accepts; streamed ones
+    // are compressed as they are written (see streamJson)
+    svr.set_post_routing_handler([](const httplib::Request&, httplib::Response& res) {
+        if (requestCoding == Coding::Identity || res.body.size() < minCompressBytes) return;
+        if (res.has_header("Content-Encoding")) return;
+        thread_local std::string scratch;
+        if (!Compressor::local(requestCoding).compress(res.body, scratch)) return;
+        res.set_header("Content-Encoding", codingName(requestCoding));
+        if (!res.has_header("Vary")) res.set_header("Vary", "Accept-Encoding");
+    });
+
+    // 3) OPTIONS preflight
+    svr.Options(R"(.*)", route("OPTIONS *", auth, [&](const auto& req, auto& res) {
+        enableCORS(req, res);
+        res.status = 204;
+    }));
+
+
+
+    // --- AUTH ROUTES ---
+
+    svr.Post("/api/signup", route("POST /api/signup", auth, [&](const auto& req, auto& res) {
+        enableCORS(req, res);
+        auto j    = nlohmann::json::parse(req.body);
+        auto user = j["username"].template get<std::string>();
+        auto pass = j["password"].template get<std::string>();
+        auto hash = std::to_string(std::hash<std::string>{}(pass));
+
+        if (db.createUser(user, hash)) {
+            res.status = 201;
+            res.set_content(R"({"message":"User created"})","application/json");
+        } else {
+            res.status = 409;
+            res.set_content(R"({"error":"Username exists"})","application/json");
+        }
+    }));
+
+    svr.Post("/api/login", route("POST /api/login", auth, [&](const auto& req, auto& res) {
+        enableCORS(req, res);
+        auto j    = nlohmann::json::parse(req.body);
+        auto user = j["username"].template get<std::string>();
+        auto pass = j["password"].template get<std::string>();
+
+        auto opt = db.getUserByUsername(user);
+        if (!opt) {
+            res.status = 401;
+            res.set_content(R"({"error":"Invalid creds"})","application/json");
+            return;
+        }
+        int uid = opt->first;
+        auto hashCheck = std::to_string(std::hash<std::string>{}(pass));
+        if (hashCheck != opt->second) {
+            res.status = 401;
+            res.set_content(R"({"error":"Invalid creds"})","application/json");
+            return;
+        }
+
+        // Create a session expiring 7 days from now
+        auto token = makeToken();
+        db.createSession(token, uid, futureISO(7));
+        setCookie(res, token);
+
+        res.set_content(R"({"message":"Logged in"})","application/json");
+    }));
+
+    svr.Post("/api/logout", route("POST /api/logout", auth, [&](const auto& req, auto& res) {
+        enableCORS(req, res);
+        if (auto tok = getSessionToken(req)) {
+            db.deleteSession(*tok);
+        }
+        clearCookie(res);
+        res.set_content(R"({"message":"Logged out"})","application/json");
+    }));
+
+    svr.Get("/api/me", route("GET /api/me", auth, [&](const auto& req, auto& res) {
+        enableCORS(req, res);
+        if (auto tok = getSessionToken(req)) {
+            if (auto uid = db.getUserIdBySession(*tok)) {
+                res.set_content(
+                    nlohmann::json{{"userId", *uid}}.dump(),
+                                "application/json"
+                );
+                return;
+            }
+        }
+        res.status = 401;
+        res.set_content(R"({"error":"Not authenticated"})","application/json");
+    }));
+
+    // --- HEALTH CHECK ---
+
+    svr.Get("/api/test", route("GET /api/test", auth, [&](const auto& req, auto& res) {
+        enableCORS(req, res);
+        res.set_content(R"({"status":"success"})","application/json");
+    }));
+
+
+    // --- BOOK CRUD ---
+
+    svr.Get("/api/books", route("GET /api/books", reads, [&](const auto& req, auto& res) {
+        int uid = requireUser(db, req, res); if (uid<0) return;
+        BookQuery query;
+        if (!parseBookQuery(req, query)) {
+            res.status = 400;
+            res.set_content(R"({"error":"Invalid listing parameters"})","application/json");
+            return;
+        }
+        // Any change to the user's library bumps the version, so an unchanged
+        // ETag is answered without reading the books table.
+        auto etag = libraryEtag(uid, db.dataVersion(uid), true);
+        res.set_header("ETag", etag);
+        res.set_header("Cache-Control", "private, no-cache");
+        res.set_header("Vary", "Accept-Encoding");
+        if (etagMatches(req, etag)) {
+            res.status = 304;
+            return;
+        }
+        // Rows are serialized straight from the cursor as the client reads.
+        streamJson(res, "streamBooks", [&db, uid, query](const JsonWriter::Sink& out) {
+            return db.streamBooks(uid, query, out);
+        });
+    }));
+
+    // Delta sync: rows changed and ids deleted since the client's version
+    svr.Get("/api/books/changes", route("GET /api/books/changes", reads, [&](const auto& req, auto& res) {
+        int uid = requireUser(db, req, res); if (uid<0) return;
+        int64_t since = 0;
+        try { since = std::stoll(req.get_param_value("since")); }
+        catch (...) {
+            res.status = 400;
+            res.set_content(R"({"error":"since must be a version number"})","application/json");
+            return;
+        }
+        int64_t current = db.dataVersion(uid);
+        if (since >= current) {
+            res.set_content(nlohmann::json{{"version", current},
+                                           {"books", nlohmann::json::array()},
+                                           {"deleted", nlohmann::json::array()}}.dump(),
+                            "application/json");
+            return;
+        }
+        streamJson(res, "streamChanges", [&db, uid, since](const JsonWriter::Sink& out) {
+            return db.streamChanges(uid, since, out);
+        });
+    }));
+
+    // Ranked full-text search of the user's own library
+    svr.Get("/api/books/search", route("GET /api/books/search", reads, [&](const auto& req, auto& res) {
+        int uid = requireUser(db, req, res); if (uid<0) return;
+        auto text = req.get_param_value("q");
+        int limit = 20, offset = 0;
+        try {
+            if (req.has_param("limit"))  limit  = std::stoi(req.get_param_value("limit"));
+            if (req.has_param("offset")) offset = std::stoi(req.get_param_value("offset"));
+        } catch (...) {
+            limit = -1;
+        }
+        if (text.empty() || limit < 1 || limit > 100 || offset < 0) {
+            res.status = 400;
+            res.set_content(R"({"error":"q is required; limit 1-100, offset >= 0"})","application/json");
+            return;
+        }
+        // Settles the user's pending updates while an error can still be
+        // sent as a status
+        db.dataVersion(uid);
+        streamJson(res, "streamSearch", [&db, uid, text, limit, offset](const JsonWriter::Sink& out) {
+            return db.streamSearch(uid, text, limit, offset, out);
+        });
+    }));
+
+    svr.Get("/api/analytics", route("GET /api/analytics", reads, [&](const auto& req, auto& res) {
+        int uid = requireUser(db, req, res); if (uid<0) return;
+        auto etag = libraryEtag(uid, db.dataVersion(uid), false);
+        res.set_header("ETag", etag);
+        res.set_header("Cache-Control", "private, no-cache");
+        res.set_header("Vary", "Accept-Encoding");
+        if (etagMatches(req, etag)) {
+            res.status = 304;
+            return;
+        }
+        LibraryStats stats = db.getAnalytics(uid);
+        nlohmann::json statusCounts = nlohmann::json::object();
+        for (auto& [status, count] : stats.statusCounts) statusCounts[status] = count;
+        nlohmann::json genres = nlohmann::json::object();
+        for (auto& [genre, count] : stats.genres) genres[genre] = count;
+        nlohmann::json out = {
+            {"total_books", stats.totalBooks},
+            {"status_counts", statusCounts},
+            {"genres", genres},
+            {"top_genre", stats.genres.empty() ? nlohmann::json(nullptr)
+                                               : nlohmann::json(stats.genres.front().first)},
+            {"rated_books", stats.ratedBooks},
+            {"average_rating", stats.ratedBooks ? nlohmann::json(double(stats.ratingSum) / stats.ratedBooks)
+                                                : nlohmann::json(nullptr)},
+            {"pages_read", stats.pagesRead},
+            {"total_pages", stats.totalPages}
+        };
+        res.set_content(out.dump(),"application/json");
+    }));
+
+    svr.Post("/api/books", route("POST /api/books", writes, [&](const auto& req, auto& res) {
+        int uid = requireUser(db, req, res); if (uid<0) return;
+        BookInputParser parser;
+        BookInput book;
+        if (!readBook(req, res, parser, book, true)) return;
+        db.addBook(uid, book);
+        res.status = 201;
+        res.set_content(R"({"message":"Book added"})","application/json");
+    }));
+
+    // Bulk import: CSV (with header) or JSON lines, parsed as the upload
+    // streams in and committed in batches. Rows that fail validation are
+    // reported and skipped; batches already committed stay if a later
+    // batch fails.
+    svr.Post("/api/books/batch", routeWithReader("POST /api/books/batch", writes,
+        [&](const httplib::Request& req, httplib::Response& res,
+            const httplib::ContentReader& content_reader) {
+        int uid = requireUser(db, req, res); if (uid<0) return;
+        auto format = req.get_param_value("format");
+        auto type = req.get_header_value("Content-Type");
+        BookImporter::Format fmt;
+        if (format == "csv" || (format.empty() && type.rfind("text/csv", 0) == 0)) {
+            fmt = BookImporter::Format::Csv;
+        } else if (format == "jsonl" ||
+                   (format.empty() && (type.rfind("application/x-ndjson", 0) == 0 ||
+                                       type.rfind("application/jsonl", 0) == 0))) {
+            fmt = BookImporter::Format::JsonLines;
+        } else {
+            res.status = 415;
+            res.set_content(R"({"error":"Send text/csv or application/x-ndjson, or pass format=csv|jsonl"})","application/json");
+            return;
+        }
+
+        BookImporter importer(fmt, [&](const std::vector<NewBook>& batch) {
+            db.importBooks(uid, batch);
+        });
+        std::string failure;
+        try {
+            content_reader([&](const char* data, size_t size) {
+                importer.feed(data, size);
+                return true;
+            });
+            importer.finish();
+        } catch (const std::exception& e) {
+            failure = e.what();
+        }
+
+        nlohmann::json errors = nlohmann::json::array();
+        for (const auto& e : importer.errors()) {
+            errors.push_back({{"row", e.row}, {"error", e.message}});
+        }
+        nlohmann::json out = {
+            {"imported", importer.imported()},
+            {"failed", importer.failed()},
+            {"errors", errors}
+        };
+        if (!failure.empty()) {
+            std::cerr << "book import failed: " << failure << "\n";
+            out["error"] = "Import stopped: " + failure;
+            res.status = 500;
+        } else {
+            res.status = importer.imported() > 0 ? 201 : 200;
+        }
+        res.set_content(out.dump(),"application/json");
+    }));
+
+    svr.Put(R"(/api/books/(\d+))", route("PUT /api/books/:id", writes, [&](const auto& req, auto& res) {
+        int uid = requireUser(db, req, res); if (uid<0) return;
+        int id = std::stoi(req.matches[1]);
+        BookInputParser parser;
+        BookInput book;
+        if (!readBook(req, res, parser, book, false)) return;
+        db.updateBook(id, uid, book);
+        res.set_content(R"({"message":"Book updated"})","application/json");
+    }));
+
+    svr.Delete(R"(/api/books/(\d+))", route("DELETE /api/books/:id", writes, [&](const auto& req, auto& res) {
+        int uid = requireUser(db, req, res); if (uid<0) return;
+        int id = std::stoi(req.matches[1]);
+        db.deleteBook(id, uid);
+        res.set_content(R"({"message":"Book deleted"})","application/json");
+    }));
+
+    // --- READING SESSIONS ---
+
+    svr.Post(R"(/api/books/(\d+)/session/start)", route("POST /api/books/:id/session/start", writes, [&](const auto& req, auto& res) {
+        int uid = requireUser(db, req, res); if (uid<0) return;
+        auto bookId = parseId(req.matches[1]);
+        if (!bookId) {
+            res.status = 404;
+            res.set_content(R"({"error":"Book not found"})","application/json");
+            return;
+        }
+        auto b = nlohmann::json::parse(req.body, nullptr, false);
+        int startPagesRead = 0;
+        if (!b.is_object() || !intField(b, "startPagesRead", 0, startPagesRead)) {
+            res.status = 400;
+            res.set_content(R"({"error":"Body must be {\"startPagesRead\":N} with N >= 0"})","application/json");
+            return;
+        }
+        int sessionId = 0;
+        if (!db.startReadingSession(uid, *bookId, nowISO(), startPagesRead, sessionId)) {
+            res.status = 404;
+            res.set_content(R"({"error":"Book not found"})","application/json");
+            return;
+        }
+        res.status = 201;
+        res.set_content(nlohmann::json{{"sessionId", sessionId}}.dump(),"application/json");
+    }));
+
+    svr.Post(R"(/api/books/(\d+)/session/stop)", route("POST /api/books/:id/session/stop", writes, [&](const auto& req, auto& res) {
+        int uid = requireUser(db, req, res); if (uid<0) return;
+        auto bookId = parseId(req.matches[1]);
+        auto b = nlohmann::json::parse(req.body, nullptr, false);
+        int sessionId = 0, endPagesRead = 0;
+        if (!b.is_object() || !intField(b, "sessionId", 0, sessionId) || !intField(b, "endPagesRead", 0, endPagesRead)) {
+            res.status = 400;
+            res.set_content(R"({"error":"Body must be {\"sessionId\":N,\"endPagesRead\":N} with N >= 0"})",
+                            "application/json");
+            return;
+        }
+        try {
+            if (!bookId || !db.stopReadingSession(uid, *bookId, sessionId, nowISO(), endPagesRead)) {
+                res.status = 404;
+                res.set_content(R"({"error":"No open session"})","application/json");
+                return;
+            }
+        } catch (const std::invalid_argument& e) {
+            res.status = 400;
+            res.set_content(nlohmann::json{{"error", e.what()}}.dump(),"application/json");
+            return;
+        }
+        res.set_content(R"({"message":"Session stopped"})","application/json");
+    }));
+
+    svr.Get("/api/sessions", route("GET /api/sessions", reads, [&](const auto& req, auto& res) {
+        int uid = requireUser(db, req, res); if (uid<0) return;
+        nlohmann::json out = nlohmann::json::array();
+        for (const auto& s : db.getReadingSessions(uid)) {
+            out.push_back({{"id", s.id}, {"bookId", s.bookId}, {"startTime", s.startTime},
+                           {"endTime", s.endTime}, {"pagesRead", s.pagesRead}});
+        }
+        res.set_content(out.dump(),"application/json");
+    }));
+
+    // Per-day totals, pace and streak from the daily rollup; defaults to
+    // the last 30 days
+    svr.Get("/api/sessions/summary", route("GET /api/sessions/summary", reads, [&](const auto& req, auto& res) {
+        int uid = requireUser(db, req, res); if (uid<0) return;
+        std::string today = nowISO().substr(0, 10);
+        std::string to   = req.has_param("to")   ? req.get_param_value("to")   : today;
+        std::string from = req.has_param("from") ? req.get_param_value("from") : futureISO(-29).substr(0, 10);
+        if (!isDay(from) || !isDay(to) || from > to) {
+            res.status = 400;
+            res.set_content(R"({"error":"from and to must be YYYY-MM-DD with from <= to"})","application/json");
+            return;
+        }
+        ReadingSummary summary = db.getReadingSummary(uid, from, to, today);
+
+        nlohmann::json days = nlohmann::json::array();
+        int64_t pages = 0, seconds = 0;
+        for (const auto& d : summary.days) {
+            days.push_back({{"date", d.day}, {"pages", d.pages},
+                            {"sessions", d.sessions}, {"minutes", d.seconds / 60}});
+            pages += d.pages;
+            seconds += d.seconds;
+        }
+        // Pace is averaged over days with reading, as the overview shows them
+        nlohmann::json out = {
+            {"from", from},
+            {"to", to},
+            {"days", days},
+            {"total_pages", pages},
+            {"active_days", summary.days.size()},
+            {"average_pages_per_day", summary.days.empty() ? 0.0 : double(pages) / summary.days.size()},
+            {"pages_per_hour", seconds > 0 ? nlohmann::json(pages * 3600.0 / seconds) : nlohmann::json(nullptr)},
+            {"streak", summary.streak}
+        };
+        res.set_content(out.dump(),"application/json");
+    }));
+
+    // Google Books proxy: cached upstream bytes are sent as-is
+    svr.Get(R"(/api/search/(.+))", route("GET /api/search/:query", external, [&](const auto& req, auto& res) {
+        enableCORS(req, res);
+        SearchCache::Body body;
+        try {
+            body = api.search(req.matches[1]);
+        } catch (const SearchOverloaded& e) {
+            res.status = 503;
+            res.set_header("Retry-After", "1");
+            res.set_content(nlohmann::json{{"error", e.what()}}.dump(),"application/json");
+            return;
+        } catch (const SearchTimeout& e) {
+            res.status = 504;
+            res.set_content(nlohmann::json{{"error", e.what()}}.dump(),"application/json");
+            return;
+        } catch (const std::exception& e) {
+            res.status = 502;
+            res.set_content(nlohmann::json{{"error", e.what()}}.dump(),"application/json");
+            return;
+        }
+        // Large answers are copied into the body so the post-routing
+        // handler can compress them; the rest go out zero-copy.
+        if (requestCoding != Coding::Identity && body->size() >= minCompressBytes) {
+            res.set_content(*body, "application/json");
+            return;
+        }
+        res.set_content_provider(body->size(), "application/json",
+            [body, permit = requestPermit](size_t offset, size_t length, httplib::DataSink& sink) {
+                streamedBytes += length;
+                return sink.write(body->data() + offset, length);
+            });
+    }));
+
+    // Cover lookup: fetches the image behind a book's thumbnail URL into
+    // the cover store on first use, then redirects to its immutable
+    // content-addressed URL. Browsers only know the thumbnail URL, so the
+    // redirect itself is cached for a day.
+    svr.Get("/api/covers", route("GET /api/covers", external, [&](const auto& req, auto& res) {
+        int uid = requireUser(db, req, res); if (uid<0) return;
+        std::string hash;
+        try {
+            hash = covers.resolve(req.get_param_value("url"));
+        } catch (const std::invalid_argument& e) {
+            res.status = 400;
+            res.set_content(nlohmann::json{{"error", e.what()}}.dump(),"application/json");
+            return;
+        } catch (const SearchTimeout& e) {
+            res.status = 504;
+            res.set_content(nlohmann::json{{"error", e.what()}}.dump(),"application/json");
+            return;
+        } catch (const std::exception& e) {
+            res.status = 502;
+            res.set_content(nlohmann::json{{"error", e.what()}}.dump(),"application/json");
+            return;
+        }
+        res.set_header("Cache-Control", "private, max-age=86400");
+        res.set_redirect("/api/covers/" + hash, 302);
+    }));
+
+    // Stored covers never change under their hash; sent from the mapping
+    svr.Get(R"(/api/covers/([0-9a-f]{64}))", route("GET /api/covers/:hash", reads, [&](const auto& req, auto& res) {
+        auto cover = covers.open(req.matches[1]);
+        if (!cover) {
+            res.status = 404;
+            res.set_content(R"({"error":"Cover not found"})","application/json");
+            return;
+        }
+        std::string etag = "\"" + std::string(req.matches[1]) + "\"";
+        res.set_header("ETag", etag);
+        res.set_header("Cache-Control", "public, max-age=31536000, immutable");
+        if (etagMatches(req, etag)) {
+            res.status = 304;
+            return;
+        }
+        res.set_content_provider(cover->size, cover->contentType,
+            [cover, permit = requestPermit](size_t offset, size_t length, httplib::DataSink& sink) {
+                streamedBytes += length;
+                return sink.write(cover->data + offset, length);
+            });
+    }));
+}
+
+// Compares secrets in time independent of where they first differ.
+static bool sameSecret(const std::string& a, const std::string& b) {
+    if (a.size() != b.size()) return false;
+    unsigned char diff = 0;
+    for (size_t i = 0; i < a.size(); ++i) diff |= static_cast<unsigned char>(a[i] ^ b[i]);
+    return diff == 0;
+}
+
+// Answers 401 unless the request carries the admin token.
+static bool requireAdmin(const httplib::Request& req, httplib::Response& res, const std::string& token) {
+    if (sameSecret(req.get_header_value("Authorization"), "Bearer " + token)) return true;
+    res.status = 401;
+    res.set_content(R"({"error":"Admin token required"})","application/json");
+    return false;
+}
+
+void registerAdminRoutes(httplib::Server& svr, Database& db, const std::string& token, Scheduler& scheduler) {
+    // Rebalancing: moves a user's library to another shard while serving.
+    // {"shard":N} -> {"userId":U,"from":F,"shard":N}
+    svr.Post(R"(/api/admin/users/(\d+)/move)", route("POST /api/admin/users/:id/move",
+        scheduler.pool(RequestClass::Write), [&db, token](const httplib::Request& req, httplib::Response& res) {
+        if (!requireAdmin(req, res, token)) return;
+        auto userId = parseId(req.matches[1]);
+        if (!userId) {
+            res.status = 404;
+            res.set_content(R"({"error":"No such user"})","application/json");
+            return;
+        }
+        auto j = nlohmann::json::parse(req.body, nullptr, false);
+        if (!j.is_object() || !j.contains("shard") || !j["shard"].is_number_integer()
+            || j["shard"].get<int64_t>() < 0 || j["shard"].get<int64_t>() > INT_MAX) {
+            res.status = 400;
+            res.set_content(R"({"error":"Body must be {\"shard\":N}"})","application/json");
+            return;
+        }
+        int shard = j["shard"].get<int>();
+        try {
+            int from = db.moveUser(*userId, shard);
+            res.set_content(nlohmann::json{{"userId", *userId}, {"from", from}, {"shard", shard}}.dump(),
+                            "application/json");
+        } catch (const std::invalid_argument& e) {
+            res.status = 404;
+            res.set_content(nlohmann::json{{"error", e.what()}}.dump(),"application/json");
+        } catch (const Database::MoveConflict& e) {
+            res.status = 409;
+            res.set_content(nlohmann::json{{"error", e.what()}}.dump(),"application/json");
+        }
+    }));
+
+    // Prometheus scrape target: request, database and search timings. Route
+    // names and latencies say too much about the service to be public.
+    svr.Get("/api/metrics", route("GET /api/metrics", scheduler.pool(RequestClass::Auth),
+        [token](const httplib::Request& req, httplib::Response& res) {
+        if (!requireAdmin(req, res, token)) return;
+        res.set_content(metrics::registry().prometheus(), "text/plain; version=0.0.4");
+    }));
+}
+
+void registerStaticAssets(httplib::Server& svr, const StaticAssets& assets, RequestPool& pool) {
+    svr.Get(R"(/.*)", route("GET static", pool, [&assets](const httplib::Request& req, httplib::Response& res) {
+        auto asset = assets.find(req.path);
+        if (!asset) {
+            res.status = 404;
+            res.set_content("Not found", "text/plain");
+            return;
+        }
+        auto encoding = StaticAssets::negotiate(req.get_header_value("Accept-Encoding"), *asset);
+        auto etag = asset->etag(encoding);
+        res.set_header("ETag", etag);
+        res.set_header("Vary", "Accept-Encoding");
+        // Pages link assets as name?v=<version>, and that URL never changes
+        // content; anything else is revalidated by ETag.
+        bool versioned = req.get_param_value("v") == asset->version;
+        res.set_header("Cache-Control", versioned ? "public, max-age=31536000, immutable" : "no-cache");
+        if (etagMatches(req, etag)) {
+            res.status = 304;
+            return;
+        }
+        if (encoding != StaticAsset::Encoding::Identity) {
+            res.set_header("Content-Encoding", encoding == StaticAsset::Encoding::Brotli ? "br" : "gzip");
+        }
+        // Sent straight from the snapshot, which the capture keeps alive
+        const std::string& body = asset->body(encoding);
+        res.set_content_provider(body.size(), asset->contentType,
+            [asset, &body, permit = requestPermit](size_t offset, size_t length, httplib::DataSink& sink) {
+                streamedBytes += length;
+                return sink.write(body.data() + offset, length);
+            });
+    }));
+}
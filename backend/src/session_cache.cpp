@@ -0,0 +1,103 @@
+#include "session_cache.h"
+#include <algorithm>
+#include <functional>
+
+SessionCache::SessionCache(std::time_t slotSeconds, size_t slotCount)
+    : slotSeconds(slotSeconds),
+      slots(slotCount),
+      wheelTick(std::time(nullptr) / slotSeconds) {}
+
+SessionCache::Shard& SessionCache::shardFor(const std::string& token) {
+    return shards[std::hash<std::string>{}(token) % shards.size()];
+}
+
+void SessionCache::put(const std::string& token, int userId, std::time_t expiresAt) {
+    {
+        Shard& shard = shardFor(token);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        shard.entries[token] = Entry{userId, expiresAt};
+    }
+    file(token, expiresAt);
+}
+
+uint64_t SessionCache::generation(const std::string& token) {
+    Shard& shard = shardFor(token);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    return shard.erasures;
+}
+
+void SessionCache::fill(const std::string& token, int userId, std::time_t expiresAt, uint64_t generation) {
+    {
+        Shard& shard = shardFor(token);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        if (shard.erasures != generation) return;
+        shard.entries[token] = Entry{userId, expiresAt};
+    }
+    file(token, expiresAt);
+}
+
+void SessionCache::file(const std::string& token, std::time_t expiresAt) {
+    {
+        std::lock_guard<std::mutex> lock(wheelMutex);
+        // Anything already due lands in the next slot to be processed.
+        long long tick = std::max<long long>(expiresAt / slotSeconds, wheelTick.load());
+        slots[tick % slots.size()].push_back(token);
+    }
+    advance(std::time(nullptr));
+}
+
+void SessionCache::erase(const std::string& token) {
+    // The wheel keeps its copy of the token; it is skipped when its slot
+    // comes up and the map no longer holds it.
+    Shard& shard = shardFor(token);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    shard.entries.erase(token);
+    ++shard.erasures;
+}
+
+SessionCache::Lookup SessionCache::get(const std::string& token, std::time_t now) {
+    advance(now);
+
+    Shard& shard = shardFor(token);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.entries.find(token);
+    if (it == shard.entries.end()) return {Status::Miss, 0};
+    if (it->second.expiresAt <= now) return {Status::Expired, 0};
+    return {Status::Hit, it->second.userId};
+}
+
+void SessionCache::advance(std::time_t now) {
+    long long target = now / slotSeconds;
+    if (wheelTick.load(std::memory_order_relaxed) >= target) return;
+
+    // One thread sweeps at a time; everyone else keeps serving lookups.
+    std::unique_lock<std::mutex> lock(wheelMutex, std::try_to_lock);
+    if (!lock.owns_lock()) return;
+
+    long long tick = wheelTick.load();
+    // After a long idle period one lap covers every slot.
+    if (target - tick > static_cast<long long>(slots.size())) {
+        tick = target - static_cast<long long>(slots.size());
+    }
+    for (; tick < target; ++tick) {
+        std::vector<std::string>& slot = slots[tick % slots.size()];
+        std::vector<std::string> keep;
+        for (std::string& token : slot) {
+            Shard& shard = shardFor(token);
+            std::unique_lock<std::shared_mutex> shardLock(shard.mutex);
+            auto it = shard.entries.find(token);
+            if (it == shard.entries.end()) continue;
+            if (it->second.expiresAt <= now) {
+                shard.entries.erase(it);
+            } else if (it->second.expiresAt / slotSeconds % static_cast<long long>(slots.size())
+                       == tick % static_cast<long long>(slots.size())) {
+                // Due on a later lap of the wheel.
+                keep.push_back(std::move(token));
+            }
+            // Otherwise the token was re-put with a new expiry and is filed
+            // in another slot.
+        }
+        slot.swap(keep);
+    }
+    wheelTick.store(target);
+}
@@ -0,0 +1,955 @@
+#include "shard.h"
+#include "metrics.h"
+#include "migrations.h"
+#include "sql.h"
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <sstream>
+#include <stdexcept>
+#include <iomanip>
+
+namespace {
+
+// The day before a YYYY-MM-DD date, or "" if it does not parse.
+std::string previousDay(const std::string& day) {
+    std::tm tm{};
+    std::istringstream ss(day);
+    ss >> std::get_time(&tm, "%Y-%m-%d");
+    if (ss.fail()) return "";
+    std::time_t t = timegm(&tm) - 24 * 3600;
+    gmtime_r(&t, &tm);
+    std::ostringstream out;
+    out << std::put_time(&tm, "%Y-%m-%d");
+    return out.str();
+}
+
+// Text column as a view into SQLite's row buffer, valid until the next step.
+std::string_view textColumn(const SQLite::Statement& q, int index) {
+    SQLite::Column c = q.getColumn(index);
+    const char* text = c.getText();
+    return std::string_view(text, c.getBytes());
+}
+
+// Writes one books row, selected in the column order used by streamBooks,
+// as a JSON object.
+void writeBook(JsonWriter& out, const SQLite::Statement& q) {
+    out.raw("{").key("id").number(q.getColumn(0).getInt64());
+    out.raw(",").key("title").string(textColumn(q, 1));
+    out.raw(",").key("author").string(textColumn(q, 2));
+    out.raw(",").key("genre").string(textColumn(q, 3));
+    out.raw(",").key("status").string(textColumn(q, 4));
+    out.raw(",").key("pagesRead").number(q.getColumn(5).getInt64());
+    out.raw(",").key("totalPages").number(q.getColumn(6).getInt64());
+    out.raw(",").key("notes").string(textColumn(q, 7));
+    out.raw(",").key("tags").string(textColumn(q, 8));
+    out.raw(",").key("goalEndDate").string(textColumn(q, 9));
+    out.raw(",").key("thumbnail").string(textColumn(q, 10));
+    out.raw(",").key("rating").number(q.getColumn(11).getInt64());
+    out.raw("}");
+}
+
+// Reads status, genre, rating, pages_read, total_pages from columns 0-4.
+BookFacts readFacts(const SQLite::Statement& q) {
+    BookFacts facts;
+    facts.status     = q.getColumn(0).getString();
+    facts.genre      = q.getColumn(1).getString();
+    facts.rating     = q.getColumn(2).getInt();
+    facts.pagesRead  = q.getColumn(3).getInt();
+    facts.totalPages = q.getColumn(4).getInt();
+    return facts;
+}
+
+// Turns free text into an FTS5 query: every word must match, as a prefix.
+// Words are quoted so FTS5 operators in user input are taken literally.
+std::string ftsQuery(const std::string& text) {
+    std::string out, word;
+    auto endWord = [&] {
+        if (word.empty()) return;
+        if (!out.empty()) out += ' ';
+        out += '"' + word + "\"*";
+        word.clear();
+    };
+    for (unsigned char c : text) {
+        // Bytes >= 0x80 belong to UTF-8 letters; unicode61 splits those.
+        if (std::isalnum(c) || c >= 0x80) word += static_cast<char>(c);
+        else endWord();
+    }
+    endWord();
+    return out;
+}
+
+const char* sortColumn(BookQuery::Sort sort) {
+    switch (sort) {
+        case BookQuery::Sort::Title:    return "title_key";
+        case BookQuery::Sort::Progress: return "progress";
+        case BookQuery::Sort::Rating:   return "rating";
+        case BookQuery::Sort::Id:       break;
+    }
+    return "id";
+}
+
+// Tags a cursor with the sort it was issued for.
+char sortCode(BookQuery::Sort sort) {
+    return "itpr"[static_cast<int>(sort)];
+}
+
+const char base64UrlAlphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+std::string base64UrlEncode(const std::string& in) {
+    std::string out;
+    out.reserve((in.size() + 2) / 3 * 4);
+    unsigned bits = 0;
+    int count = 0;
+    for (unsigned char c : in) {
+        bits = (bits << 8) | c;
+        count += 8;
+        while (count >= 6) {
+            count -= 6;
+            out += base64UrlAlphabet[(bits >> count) & 0x3F];
+        }
+    }
+    if (count > 0) out += base64UrlAlphabet[(bits << (6 - count)) & 0x3F];
+    return out;
+}
+
+bool base64UrlDecode(const std::string& in, std::string& out) {
+    out.clear();
+    unsigned bits = 0;
+    int count = 0;
+    for (char c : in) {
+        const char* pos = std::strchr(base64UrlAlphabet, c);
+        if (c == '\0' || pos == nullptr) return false;
+        bits = (bits << 6) | static_cast<unsigned>(pos - base64UrlAlphabet);
+        count += 6;
+        if (count >= 8) {
+            count -= 8;
+            out += static_cast<char>((bits >> count) & 0xFF);
+        }
+    }
+    return true;
+}
+
+// Opaque keyset cursor for the current row of a streamBooks query, whose
+// column 12 is the sort key.
+std::string encodeCursor(BookQuery::Sort sort, const SQLite::Statement& q) {
+    std::string key;
+    if (sort == BookQuery::Sort::Progress) {
+        char digits[32];
+        std::snprintf(digits, sizeof digits, "%.17g", q.getColumn(12).getDouble());
+        key = digits;
+    } else if (sort != BookQuery::Sort::Id) {
+        key = textColumn(q, 12);
+    }
+    return base64UrlEncode(std::string(1, sortCode(sort)) + "|" +
+                           std::to_string(q.getColumn(0).getInt()) + "|" + key);
+}
+
+// Latency of one database method. Streaming methods include the time the
+// sink spends handing rows to the client.
+metrics::Histogram& methodTiming(const char* method) {
+    return metrics::registry().histogram("booktracker_db_seconds", "Time spent in Database methods",
+                                         std::string("method=\"") + method + "\"");
+}
+
+// Tables holding per-user rows, with the columns a move copies. book_tags
+// is handled separately because tag ids differ between shards.
+struct UserTable {
+    const char* name;
+    const char* columns;
+};
+const UserTable userTables[] = {
+    {"books", "id, user_id, title, author, genre, status, pages_read, total_pages, "
+              "notes, tags, goal_end_date, thumbnail, rating, updated_version"},
+    {"reading_sessions", "id, user_id, book_id, start_time, start_pages_read, end_time, end_pages_read"},
+    {"book_tombstones", "user_id, book_id, version, deleted_at"},
+    {"user_versions", "user_id, version, pruned_version"},
+    {"user_book_stats", "user_id, books, rated_books, rating_sum, pages_read, total_pages"},
+    {"user_status_counts", "user_id, status, count"},
+    {"user_genre_counts", "user_id, genre, count"},
+    {"reading_daily", "user_id, day, pages, sessions, seconds"},
+};
+
+// How long a deletion stays visible to delta sync. A client whose last
+// sync predates the pruned tombstones is told to resync in full.
+constexpr std::time_t tombstoneRetentionSeconds = 90 * 24 * 3600;
+
+// Drops the user's tombstones written before cutoff, along with any of a
+// lower version, inside the caller's transaction, and records the newest
+// version dropped as the user's pruned_version.
+void pruneTombstones(Connection& conn, int userId, std::time_t cutoff) {
+    int64_t pruned;
+    {
+        auto q = conn.prepare(
+            "SELECT MAX(version) FROM book_tombstones WHERE user_id = ? AND deleted_at < ?");
+        sql::bind(*q, userId, static_cast<int64_t>(cutoff));
+        if (!q->executeStep() || q->getColumn(0).isNull()) return;
+        pruned = q->getColumn(0).getInt64();
+    }
+    {
+        auto q = conn.prepare("DELETE FROM book_tombstones WHERE user_id = ? AND version <= ?");
+        sql::bind(*q, userId, pruned);
+        q->exec();
+    }
+    {
+        auto q = conn.prepare(
+            "UPDATE user_versions SET pruned_version = MAX(pruned_version, ?) WHERE user_id = ?");
+        sql::bind(*q, pruned, userId);
+        q->exec();
+    }
+}
+
+// Deletes all of the user's rows inside the caller's transaction. Deleting
+// books fires the FTS triggers, so the search index follows.
+void deleteUserRows(Connection& conn, int userId) {
+    std::vector<std::string> tables = {"book_tags"};
+    for (const UserTable& t : userTables) tables.push_back(t.name);
+    for (const std::string& table : tables) {
+        SQLite::Statement q(conn, "DELETE FROM main." + table + " WHERE user_id = ?");
+        q.bind(1, userId);
+        q.exec();
+    }
+}
+
+} // namespace
+
+Shard::Shard(const std::string& path, IdAllocator& ids, size_t readers)
+    : filePath(path),
+      ids(ids),
+      pool(path, readers),
+      tagIndex([this](int userId, const std::function<void(int, int64_t)>& row) {
+          auto conn = pool.reader();
+          auto q = conn->prepare(
+              "SELECT tag_id, book_id FROM book_tags WHERE user_id = ? ORDER BY tag_id, book_id");
+          sql::bind(*q, userId);
+          while (q->executeStep()) row(q->getColumn(0).getInt(), q->getColumn(1).getInt64());
+      }),
+      writeBehind([this](const std::vector<BookUpdate>& group) { commitUpdates(group); }) {
+    auto conn = pool.writer();
+    migrate(*conn);
+
+    // deleteBook prunes as it goes; this catches users who stopped deleting.
+    std::time_t cutoff = std::time(nullptr) - tombstoneRetentionSeconds;
+    SQLite::Transaction tx(*conn);
+    std::vector<int> users;
+    {
+        auto q = conn->prepare("SELECT DISTINCT user_id FROM book_tombstones WHERE deleted_at < ?");
+        sql::bind(*q, static_cast<int64_t>(cutoff));
+        while (q->executeStep()) users.push_back(q->getColumn(0).getInt());
+    }
+    for (int userId : users) pruneTombstones(*conn, userId, cutoff);
+    tx.commit();
+}
+
+template <>
+struct sql::Columns<ReadingSession> {
+    static constexpr auto fields = std::make_tuple(
+        &ReadingSession::id, &ReadingSession::bookId, &ReadingSession::startTime,
+        &ReadingSession::endTime, &ReadingSession::pagesRead);
+};
+
+bool BookQuery::setCursor(const std::string& cursor) {
+    // "<sort>|<id>|<key>", see encodeCursor
+    std::string decoded;
+    if (!base64UrlDecode(cursor, decoded)) return false;
+    size_t bar1 = decoded.find('|');
+    size_t bar2 = bar1 == std::string::npos ? bar1 : decoded.find('|', bar1 + 1);
+    if (bar1 != 1 || bar2 == std::string::npos) return false;
+    if (decoded[0] != sortCode(sort)) return false;
+
+    char* end = nullptr;
+    long id = std::strtol(decoded.c_str() + bar1 + 1, &end, 10);
+    if (end != decoded.c_str() + bar2) return false;
+
+    hasCursor = true;
+    afterId  = static_cast<int>(id);
+    afterKey = decoded.substr(bar2 + 1);
+    return true;
+}
+
+bool Shard::streamBooks(int userId, const BookQuery& query, const JsonWriter::Sink& sink) {
+    static metrics::Histogram& timing = methodTiming("streamBooks");
+    metrics::Timer timer(timing);
+    // Each sort has an index on (user_id, key, id) and (user_id, status,
+    // key, id), so both the ordering and the keyset seek come from the
+    // index and a page costs O(log n + limit).
+    const char* key = sortColumn(query.sort);
+    const char* dir = query.descending ? " DESC" : "";
+    std::string text =
+        "SELECT id, title, author, genre, status, pages_read, total_pages, notes, tags, goal_end_date, thumbnail, rating";
+    text += ", ";
+    text += key;
+    text += " FROM books WHERE user_id = ?";
+    if (!query.status.empty()) text += " AND status = ?";
+    if (!query.tags.empty()) text += " AND id IN (SELECT value FROM json_each(?))";
+    if (query.hasCursor) {
+        const char* op = query.descending ? " < " : " > ";
+        text += query.sort == BookQuery::Sort::Id
+            ? std::string(" AND id") + op + "?"
+            : std::string(" AND (") + key + ", id)" + op + "(?, ?)";
+    }
+    text += " ORDER BY ";
+    if (query.sort != BookQuery::Sort::Id) {
+        text += key;
+        text += dir;
+        text += ", ";
+    }
+    text += "id";
+    text += dir;
+    if (query.limit > 0) text += " LIMIT ?";
+
+    writeBehind.waitForUser(userId);
+    // Tags are matched against the in-memory bitmaps; SQL only sees the
+    // resulting ids, as a JSON array.
+    std::string tagged;
+    if (!query.tags.empty()) {
+        tagged = "[";
+        for (uint32_t id : tagIndex.books(userId, tagIds(query.tags), query.anyTag)) {
+            if (tagged.size() > 1) tagged += ',';
+            tagged += std::to_string(id);
+        }
+        tagged += "]";
+    }
+
+    JsonWriter out(sink);
+    auto conn = pool.reader();
+    auto q = conn->prepare(text);
+    int param = 1;
+    q->bind(param++, userId);
+    if (!query.status.empty()) q->bind(param++, query.status);
+    if (!query.tags.empty()) q->bind(param++, tagged);
+    if (query.hasCursor) {
+        switch (query.sort) {
+            case BookQuery::Sort::Id:       break;
+            case BookQuery::Sort::Title:    q->bind(param++, query.afterKey); break;
+            case BookQuery::Sort::Progress: q->bind(param++, std::strtod(query.afterKey.c_str(), nullptr)); break;
+            case BookQuery::Sort::Rating:   q->bind(param++, std::atoi(query.afterKey.c_str())); break;
+        }
+        q->bind(param++, query.afterId);
+    }
+    // One extra row tells us whether another page follows.
+    if (query.limit > 0) q->bind(param++, query.limit + 1);
+
+    if (query.limit > 0) out.raw("{").key("books");
+    out.raw("[");
+    int written = 0;
+    bool more = false;
+    std::string nextCursor;
+    while (out.ok() && q->executeStep()) {
+        if (query.limit > 0 && written == query.limit) {
+            more = true;
+            break;
+        }
+        if (written++ > 0) out.raw(",");
+        writeBook(out, *q);
+        if (written == query.limit) nextCursor = encodeCursor(query.sort, *q);
+    }
+    out.raw("]");
+    if (query.limit > 0) {
+        out.raw(",").key("nextCursor");
+        if (more) out.string(nextCursor);
+        else      out.raw("null");
+        out.raw("}");
+    }
+    return out.flush();
+}
+
+bool Shard::streamChanges(int userId, int64_t since, const JsonWriter::Sink& sink) {
+    static metrics::Histogram& timing = methodTiming("streamChanges");
+    metrics::Timer timer(timing);
+    writeBehind.waitForUser(userId);
+    JsonWriter out(sink);
+    auto conn = pool.reader();
+    // One read transaction, so the version matches the rows reported.
+    SQLite::Transaction snapshot(*conn);
+
+    int64_t version = 0, pruned = 0;
+    {
+        auto q = conn->prepare("SELECT version, pruned_version FROM user_versions WHERE user_id = ?");
+        sql::bind(*q, userId);
+        if (q->executeStep()) {
+            version = q->getColumn(0).getInt64();
+            pruned  = q->getColumn(1).getInt64();
+        }
+    }
+    out.raw("{").key("version").number(version);
+    // Deletions after `since` may have been pruned: send every book instead
+    // and have the client replace its copy.
+    bool resync = since < pruned;
+    if (resync) {
+        since = -1;
+        out.raw(",").key("resync").raw("true");
+    }
+
+    out.raw(",").key("books").raw("[");
+    {
+        auto q = conn->prepare(
+            "SELECT id, title, author, genre, status, pages_read, total_pages, notes, tags, goal_end_date, thumbnail, rating "
+            "FROM books WHERE user_id = ? AND updated_version > ?");
+        sql::bind(*q, userId, since);
+        for (bool first = true; out.ok() && q->executeStep(); first = false) {
+            if (!first) out.raw(",");
+            writeBook(out, *q);
+        }
+    }
+    out.raw("]");
+
+    out.raw(",").key("deleted").raw("[");
+    {
+        auto q = conn->prepare(
+            "SELECT book_id FROM book_tombstones WHERE user_id = ? AND version > ?");
+        sql::bind(*q, userId, resync ? version : since);
+        for (bool first = true; out.ok() && q->executeStep(); first = false) {
+            if (!first) out.raw(",");
+            out.number(q->getColumn(0).getInt64());
+        }
+    }
+    out.raw("]}");
+    snapshot.commit();
+    return out.flush();
+}
+
+bool Shard::streamSearch(int userId, const std::string& text, int limit, int offset,
+                            const JsonWriter::Sink& sink) {
+    static metrics::Histogram& timing = methodTiming("streamSearch");
+    metrics::Timer timer(timing);
+    JsonWriter out(sink);
+    std::string match = ftsQuery(text);
+    if (match.empty()) {
+        out.raw(R"({"books":[],"nextOffset":null})");
+        return out.flush();
+    }
+
+    writeBehind.waitForUser(userId);
+    auto conn = pool.reader();
+    // The owner token confines the match to the user's own postings; the
+    // words only match the text columns. Title hits outrank author, tag and
+    // then notes hits, and the owner column does not score.
+    match = "owner : \"u" + std::to_string(userId) + "\" AND {title author notes tags} : (" + match + ")";
+    auto q = conn->prepare(R"(
+        SELECT b.id, b.title, b.author, b.genre, b.status, b.pages_read, b.total_pages,
+               b.notes, b.tags, b.goal_end_date, b.thumbnail, b.rating
+        FROM books_fts JOIN books b ON b.id = books_fts.rowid
+        WHERE books_fts MATCH ? AND b.user_id = ?
+        ORDER BY bm25(books_fts, 0.0, 10.0, 5.0, 1.0, 3.0), b.id
+        LIMIT ? OFFSET ?
+    )");
+    // One extra row tells us whether another page follows.
+    sql::bind(*q, match, userId, limit + 1, offset);
+
+    out.raw("{").key("books").raw("[");
+    int written = 0;
+    bool more = false;
+    while (out.ok() && q->executeStep()) {
+        if (written == limit) {
+            more = true;
+            break;
+        }
+        if (written++ > 0) out.raw(",");
+        writeBook(out, *q);
+    }
+    out.raw("],").key("nextOffset");
+    if (more) out.number(static_cast<int64_t>(offset) + limit);
+    else      out.raw("null");
+    out.raw("}");
+    return out.flush();
+}
+
+void Shard::addBook(int userId, const BookInput& book) {
+    static metrics::Histogram& timing = methodTiming("addBook");
+    metrics::Timer timer(timing);
+    // Taken before the writer, so a block refill never waits on it
+    int64_t id = ids.take("books");
+    auto conn = pool.writer();
+    SQLite::Transaction tx(*conn);
+    int64_t version = bumpVersion(*conn, userId);
+    {
+        auto q = conn->prepare(R"(
+            INSERT INTO books
+                (id, user_id, title, author, genre, status,
+                 pages_read, total_pages, notes, tags,
+                 goal_end_date, thumbnail, rating, updated_version)
+            VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?,?)
+        )");
+        sql::bind(*q, id, userId, book.title, book.author, book.genre, book.status,
+                  book.pagesRead, book.totalPages, book.notes, book.tags,
+                  book.goalEndDate, book.thumbnail, book.rating, version);
+        q->exec();
+    }
+    if (!book.tags.empty()) TagWriter(*conn).add(userId, id, std::string(book.tags));
+    BookFacts after{std::string(book.status), std::string(book.genre), book.rating,
+                    book.pagesRead, book.totalPages};
+    analytics::applyChange(*conn, userId, nullptr, &after);
+    tx.commit();
+    publishVersion(userId, version);
+    if (!book.tags.empty()) tagIndex.invalidate(userId);
+}
+
+void Shard::importBooks(int userId, const std::vector<NewBook>& books) {
+    static metrics::Histogram& timing = methodTiming("importBooks");
+    metrics::Timer timer(timing);
+    if (books.empty()) return;
+    int64_t firstId = ids.take("books", static_cast<int64_t>(books.size()));
+    auto conn = pool.writer();
+    SQLite::Transaction tx(*conn);
+    int64_t version = bumpVersion(*conn, userId);
+    std::vector<BookFacts> added;
+    added.reserve(books.size());
+
+    // Rows are staged and moved into books by a single statement: FTS5
+    // flushes its pending index data at every statement boundary, so one
+    // trigger-firing INSERT per row would write one index segment per book.
+    conn->exec(R"(
+        CREATE TEMP TABLE IF NOT EXISTS import_books (
+            id, title, author, genre, status, pages_read, total_pages,
+            notes, tags, goal_end_date, thumbnail, rating
+        )
+    )");
+    {
+        auto q = conn->prepare(
+            "INSERT INTO temp.import_books VALUES (?,?,?,?,?,?,?,?,?,?,?,?)");
+        int64_t id = firstId;
+        for (const NewBook& b : books) {
+            sql::bind(*q, id++, b.title, b.author, b.genre, b.status,
+                      b.pagesRead, b.totalPages, b.notes, b.tags,
+                      b.goalEndDate, b.thumbnail, b.rating);
+            q->exec();
+            q->reset();
+            added.push_back(BookFacts{b.status, b.genre, b.rating, b.pagesRead, b.totalPages});
+        }
+    }
+    {
+        auto q = conn->prepare(R"(
+            INSERT INTO books
+                (id, user_id, title, author, genre, status,
+                 pages_read, total_pages, notes, tags,
+                 goal_end_date, thumbnail, rating, updated_version)
+            SELECT id, ?, title, author, genre, status,
+                   pages_read, total_pages, notes, tags,
+                   goal_end_date, thumbnail, rating, ?
+            FROM temp.import_books ORDER BY rowid
+        )");
+        sql::bind(*q, userId, version);
+        q->exec();
+    }
+    conn->exec("DELETE FROM temp.import_books");
+
+    // This batch's books are exactly the user's rows stamped with its version.
+    bool tagged = false;
+    {
+        TagWriter tagWriter(*conn);
+        auto q = conn->prepare(
+            "SELECT id, tags FROM books WHERE user_id = ? AND updated_version = ? AND tags <> ''");
+        sql::bind(*q, userId, version);
+        while (q->executeStep()) {
+            tagWriter.add(userId, q->getColumn(0).getInt64(), q->getColumn(1).getString());
+            tagged = true;
+        }
+    }
+    analytics::applyInserts(*conn, userId, added);
+    tx.commit();
+    publishVersion(userId, version);
+    if (tagged) tagIndex.invalidate(userId);
+}
+
+void Shard::updateBook(int id, int userId, const BookInput& book) {
+    static metrics::Histogram& timing = methodTiming("updateBook");
+    metrics::Timer timer(timing);
+    writeBehind.push(BookUpdate{id, userId, std::string(book.status), book.pagesRead, book.totalPages,
+                                std::string(book.notes), std::string(book.tags),
+                                std::string(book.goalEndDate), std::string(book.thumbnail), book.rating});
+}
+
+void Shard::commitUpdates(const std::vector<BookUpdate>& group) {
+    static metrics::Histogram& timing = methodTiming("commitUpdates");
+    metrics::Timer timer(timing);
+    auto conn = pool.writer();
+    SQLite::Transaction tx(*conn);
+    // One version per user per group, bumped only once one of their
+    // updates matches a row.
+    std::unordered_map<int, int64_t> bumped;
+    TagWriter tagWriter(*conn);
+    std::vector<int> retagged;
+    for (const BookUpdate& u : group) {
+        BookFacts before;
+        bool tagsChanged;
+        {
+            auto q = conn->prepare(
+                "SELECT status, genre, rating, pages_read, total_pages, tags FROM books WHERE id = ? AND user_id = ?");
+            sql::bind(*q, u.id, u.userId);
+            // Deleted meanwhile, or never the user's
+            if (!q->executeStep()) continue;
+            before = readFacts(*q);
+            tagsChanged = q->getColumn(5).getString() != u.tags;
+        }
+        auto it = bumped.find(u.userId);
+        if (it == bumped.end()) it = bumped.emplace(u.userId, bumpVersion(*conn, u.userId)).first;
+        {
+            auto q = conn->prepare(R"(
+                UPDATE books SET
+                    status          = ?,
+                    pages_read      = ?,
+                    total_pages     = ?,
+                    notes           = ?,
+                    tags            = ?,
+                    goal_end_date   = ?,
+                    thumbnail       = ?,
+                    rating          = ?,
+                    updated_version = ?
+                WHERE id = ? AND user_id = ?
+            )");
+            sql::bind(*q, u.status, u.pagesRead, u.totalPages, u.notes, u.tags,
+                      u.goalEndDate, u.thumbnail, u.rating, it->second, u.id, u.userId);
+            q->exec();
+        }
+        if (tagsChanged) {
+            tagWriter.replace(u.userId, u.id, u.tags);
+            retagged.push_back(u.userId);
+        }
+        BookFacts after{u.status, before.genre, u.rating, u.pagesRead, u.totalPages};
+        analytics::applyChange(*conn, u.userId, &before, &after);
+    }
+    tx.commit();
+    for (const auto& [userId, version] : bumped) publishVersion(userId, version);
+    for (int userId : retagged) tagIndex.invalidate(userId);
+}
+
+void Shard::deleteBook(int id, int userId) {
+    static metrics::Histogram& timing = methodTiming("deleteBook");
+    metrics::Timer timer(timing);
+    auto conn = pool.writer();
+    SQLite::Transaction tx(*conn);
+    int64_t version = bumpVersion(*conn, userId);
+    bool retagged;
+    {
+        auto q = conn->prepare(
+            "DELETE FROM books WHERE id = ? AND user_id = ? "
+            "RETURNING status, genre, rating, pages_read, total_pages");
+        sql::bind(*q, id, userId);
+        if (!q->executeStep()) return;
+        BookFacts before = readFacts(*q);
+        q->executeStep();    // finish the statement before the next write
+        analytics::applyChange(*conn, userId, &before, nullptr);
+    }
+    {
+        auto q = conn->prepare("DELETE FROM book_tags WHERE book_id = ?");
+        sql::bind(*q, id);
+        retagged = q->exec() > 0;
+    }
+    {
+        // Lets delta-sync clients learn about the deletion.
+        auto q = conn->prepare(
+            "INSERT OR REPLACE INTO book_tombstones (user_id, book_id, version, deleted_at) VALUES (?,?,?,?)");
+        std::time_t now = std::time(nullptr);
+        sql::bind(*q, userId, id, version, static_cast<int64_t>(now));
+        q->exec();
+        pruneTombstones(*conn, userId, now - tombstoneRetentionSeconds);
+    }
+    tx.commit();
+    publishVersion(userId, version);
+    if (retagged) tagIndex.invalidate(userId);
+}
+
+std::vector<int> Shard::tagIds(const std::vector<std::string>& names) {
+    std::vector<int> ids;
+    auto conn = pool.reader();
+    auto q = conn->prepare("SELECT id FROM tags WHERE name = ?");
+    for (const std::string& name : names) {
+        sql::bind(*q, name);
+        // Unknown names map to an id no book carries.
+        ids.push_back(q->executeStep() ? q->getColumn(0).getInt() : -1);
+        q->reset();
+    }
+    return ids;
+}
+
+int64_t Shard::dataVersion(int userId) {
+    static metrics::Histogram& timing = methodTiming("dataVersion");
+    metrics::Timer timer(timing);
+    // A pending update will bump the version; settle it first so an ETag
+    // never vouches for data the user has already changed.
+    writeBehind.waitForUser(userId);
+    {
+        std::lock_guard<std::mutex> lock(versionMutex);
+        auto it = versions.find(userId);
+        if (it != versions.end()) return it->second;
+    }
+    int64_t version = 0;
+    {
+        auto conn = pool.reader();
+        auto q = conn->prepare("SELECT version FROM user_versions WHERE user_id = ?");
+        sql::bind(*q, userId);
+        if (q->executeStep()) version = q->getColumn(0).getInt64();
+    }
+    // A writer may have published a newer version while we read; never
+    // replace it with ours.
+    std::lock_guard<std::mutex> lock(versionMutex);
+    return versions.try_emplace(userId, version).first->second;
+}
+
+int64_t Shard::bumpVersion(Connection& conn, int userId) {
+    auto q = conn.prepare(R"(
+        INSERT INTO user_versions (user_id, version) VALUES (?, 1)
+        ON CONFLICT(user_id) DO UPDATE SET version = version + 1
+        RETURNING version
+    )");
+    sql::bind(*q, userId);
+    q->executeStep();
+    return q->getColumn(0).getInt64();
+}
+
+void Shard::publishVersion(int userId, int64_t version) {
+    // Called with the writer still leased, so versions only move forward.
+    std::lock_guard<std::mutex> lock(versionMutex);
+    versions[userId] = version;
+}
+
+void Shard::forgetUser(int userId) {
+    {
+        std::lock_guard<std::mutex> lock(versionMutex);
+        versions.erase(userId);
+    }
+    tagIndex.invalidate(userId);
+}
+
+LibraryStats Shard::getAnalytics(int userId) {
+    static metrics::Histogram& timing = methodTiming("getAnalytics");
+    metrics::Timer timer(timing);
+    writeBehind.waitForUser(userId);
+    auto conn = pool.reader();
+    // The three tables are read as of one commit.
+    SQLite::Transaction snapshot(*conn);
+    LibraryStats stats = analytics::load(*conn, userId);
+    snapshot.commit();
+    return stats;
+}
+
+int Shard::rebuildAnalytics() {
+    static metrics::Histogram& timing = methodTiming("rebuildAnalytics");
+    metrics::Timer timer(timing);
+    auto conn = pool.writer();
+    SQLite::Transaction tx(*conn);
+    int mismatched = analytics::verify(*conn);
+    analytics::rebuild(*conn);
+    tx.commit();
+    return mismatched;
+}
+
+// Reading-session implementations
+
+bool Shard::startReadingSession(int userId,
+                                   int bookId,
+                                   const std::string& startTime,
+                                   int startPagesRead,
+                                   int& outSessionId) {
+    static metrics::Histogram& timing = methodTiming("startReadingSession");
+    metrics::Timer timer(timing);
+    int64_t id = ids.take("reading_sessions");
+    auto conn = pool.writer();
+    SQLite::Transaction tx(*conn);
+    {
+        // Inserts nothing unless the book is the user's.
+        auto q = conn->prepare(R"(
+            INSERT INTO reading_sessions
+                (id, user_id, book_id, start_time, start_pages_read)
+            SELECT ?, user_id, id, ?, ? FROM books WHERE id = ? AND user_id = ?
+        )");
+        sql::bind(*q, id, startTime, startPagesRead, bookId, userId);
+        if (q->exec() == 0) return false;
+    }
+    outSessionId = static_cast<int>(id);
+    int64_t version = bumpVersion(*conn, userId);
+    tx.commit();
+    publishVersion(userId, version);
+    return true;
+}
+
+bool Shard::stopReadingSession(int userId,
+                                  int bookId,
+                                  int sessionId,
+                                  const std::string& endTime,
+                                  int endPagesRead) {
+    static metrics::Histogram& timing = methodTiming("stopReadingSession");
+    metrics::Timer timer(timing);
+    auto conn = pool.writer();
+    SQLite::Transaction tx(*conn);
+    DailyReading delta;
+    {
+        // Only open sessions, so a repeated stop cannot count twice, and
+        // never fewer pages than at the start, which would subtract from
+        // the daily rollup.
+        auto q = conn->prepare(R"(
+            UPDATE reading_sessions
+            SET end_time = ?, end_pages_read = ?
+            WHERE id = ? AND user_id = ? AND book_id = ? AND end_time IS NULL
+              AND start_pages_read <= ?
+            RETURNING substr(start_time, 1, 10),
+                      end_pages_read - start_pages_read,
+                      CAST(round((julianday(end_time) - julianday(start_time)) * 86400) AS INTEGER)
+        )");
+        sql::bind(*q, endTime, endPagesRead, sessionId, userId, bookId, endPagesRead);
+        if (!q->executeStep()) {
+            auto open = conn->prepare(R"(
+                SELECT 1 FROM reading_sessions
+                WHERE id = ? AND user_id = ? AND book_id = ? AND end_time IS NULL
+            )");
+            sql::bind(*open, sessionId, userId, bookId);
+            if (open->executeStep()) {
+                throw std::invalid_argument("endPagesRead is below the session's starting page count");
+            }
+            return false;
+        }
+        delta.day     = q->getColumn(0).getString();
+        delta.pages   = q->getColumn(1).getInt64();
+        delta.seconds = q->getColumn(2).getInt64();
+        q->executeStep();    // finish the statement before the next write
+    }
+    {
+        auto q = conn->prepare(R"(
+            INSERT INTO reading_daily (user_id, day, pages, sessions, seconds)
+            VALUES (?,?,?,1,?)
+            ON CONFLICT(user_id, day) DO UPDATE SET
+                pages    = pages + excluded.pages,
+                sessions = sessions + 1,
+                seconds  = seconds + excluded.seconds
+        )");
+        sql::bind(*q, userId, delta.day, delta.pages, delta.seconds);
+        q->exec();
+    }
+    int64_t version = bumpVersion(*conn, userId);
+    tx.commit();
+    publishVersion(userId, version);
+    return true;
+}
+
+std::vector<ReadingSession> Shard::getReadingSessions(int userId) {
+    static metrics::Histogram& timing = methodTiming("getReadingSessions");
+    metrics::Timer timer(timing);
+    std::vector<ReadingSession> out;
+    auto conn = pool.reader();
+    auto q = conn->prepare(R"(
+        SELECT id, book_id, start_time, end_time,
+               (end_pages_read - start_pages_read) AS pages_read
+        FROM reading_sessions
+        WHERE user_id = ?
+    )");
+    sql::bind(*q, userId);
+
+    while (q->executeStep()) {
+        out.push_back(sql::readRow<ReadingSession>(*q));
+    }
+
+    return out;
+}
+
+template <>
+struct sql::Columns<DailyReading> {
+    static constexpr auto fields = std::make_tuple(
+        &DailyReading::day, &DailyReading::pages, &DailyReading::sessions, &DailyReading::seconds);
+};
+
+ReadingSummary Shard::getReadingSummary(int userId,
+                                           const std::string& from,
+                                           const std::string& to,
+                                           const std::string& today) {
+    static metrics::Histogram& timing = methodTiming("getReadingSummary");
+    metrics::Timer timer(timing);
+    ReadingSummary summary;
+    auto conn = pool.reader();
+    SQLite::Transaction snapshot(*conn);
+    {
+        auto q = conn->prepare(
+            "SELECT day, pages, sessions, seconds FROM reading_daily "
+            "WHERE user_id = ? AND day BETWEEN ? AND ? ORDER BY day");
+        sql::bind(*q, userId, from, to);
+        while (q->executeStep()) {
+            summary.days.push_back(sql::readRow<DailyReading>(*q));
+        }
+    }
+    {
+        // Walk back from today and stop at the first gap, so this reads
+        // streak + 1 rows at most.
+        auto q = conn->prepare(
+            "SELECT day FROM reading_daily "
+            "WHERE user_id = ? AND day <= ? AND pages > 0 ORDER BY day DESC");
+        sql::bind(*q, userId, today);
+        std::string expected = today;
+        while (q->executeStep() && q->getColumn(0).getString() == expected) {
+            ++summary.streak;
+            expected = previousDay(expected);
+        }
+    }
+    snapshot.commit();
+    return summary;
+}
+
+// Moving users between shards
+
+void Shard::flushUser(int userId) {
+    writeBehind.waitForUser(userId);
+}
+
+void Shard::copyUser(int userId, const std::string& sourcePath) {
+    static metrics::Histogram& timing = methodTiming("copyUser");
+    metrics::Timer timer(timing);
+    auto conn = pool.writer();
+    // ATTACH cannot run inside a transaction, so the source is attached
+    // around it. The copy reads one snapshot of the source.
+    {
+        SQLite::Statement attach(*conn, "ATTACH DATABASE ? AS source");
+        attach.bind(1, sourcePath);
+        attach.exec();
+    }
+    try {
+        SQLite::Transaction tx(*conn);
+        // Leftovers of an earlier move that was interrupted
+        deleteUserRows(*conn, userId);
+        for (const UserTable& t : userTables) {
+            SQLite::Statement q(*conn, std::string("INSERT INTO main.") + t.name + " (" + t.columns + ") " +
+                                       "SELECT " + t.columns + " FROM source." + t.name + " WHERE user_id = ?");
+            q.bind(1, userId);
+            q.exec();
+        }
+        // Tag ids are per shard, so tags are re-interned by name.
+        {
+            SQLite::Statement q(*conn, R"(
+                INSERT OR IGNORE INTO main.tags (name)
+                SELECT DISTINCT st.name FROM source.book_tags bt
+                JOIN source.tags st ON st.id = bt.tag_id
+                WHERE bt.user_id = ?
+            )");
+            q.bind(1, userId);
+            q.exec();
+        }
+        {
+            SQLite::Statement q(*conn, R"(
+                INSERT INTO main.book_tags (book_id, tag_id, user_id)
+                SELECT bt.book_id, mt.id, bt.user_id FROM source.book_tags bt
+                JOIN source.tags st ON st.id = bt.tag_id
+                JOIN main.tags mt ON mt.name = st.name
+                WHERE bt.user_id = ?
+            )");
+            q.bind(1, userId);
+            q.exec();
+        }
+        tx.commit();
+    } catch (...) {
+        conn->exec("DETACH DATABASE source");
+        throw;
+    }
+    conn->exec("DETACH DATABASE source");
+    forgetUser(userId);
+}
+
+void Shard::dropUser(int userId) {
+    static metrics::Histogram& timing = methodTiming("dropUser");
+    metrics::Timer timer(timing);
+    auto conn = pool.writer();
+    SQLite::Transaction tx(*conn);
+    deleteUserRows(*conn, userId);
+    tx.commit();
+    forgetUser(userId);
+}
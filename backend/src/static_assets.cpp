@@ -0,0 +1,292 @@
+#include "static_assets.h"
+#include "compression.h"
+#include <zlib.h>
+#ifdef BOOKTRACKER_HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char* contentTypeFor(const std::string& extension) {
+    static const std::unordered_map<std::string, const char*> types = {
+        {".html", "text/html; charset=utf-8"},
+        {".js",   "text/javascript; charset=utf-8"},
+        {".css",  "text/css; charset=utf-8"},
+        {".json", "application/json"},
+        {".svg",  "image/svg+xml"},
+        {".txt",  "text/plain; charset=utf-8"},
+        {".ico",  "image/x-icon"},
+        {".png",  "image/png"},
+        {".jpg",  "image/jpeg"},
+        {".jpeg", "image/jpeg"},
+        {".gif",  "image/gif"},
+        {".webp", "image/webp"},
+        {".woff2", "font/woff2"},
+    };
+    auto it = types.find(extension);
+    return it == types.end() ? "application/octet-stream" : it->second;
+}
+
+// Already-compressed formats are not worth a second pass.
+bool compressible(const std::string& contentType) {
+    return contentType.rfind("text/", 0) == 0 || contentType == "application/json" ||
+           contentType == "image/svg+xml" || contentType == "image/x-icon";
+}
+
+// 64-bit FNV-1a; stable across builds, unlike std::hash.
+std::string contentHash(const std::string& data) {
+    uint64_t h = 1469598103934665603ull;
+    for (unsigned char c : data) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    char hex[17];
+    std::snprintf(hex, sizeof hex, "%016llx", static_cast<unsigned long long>(h));
+    return hex;
+}
+
+std::string gzipCompress(const std::string& data) {
+    z_stream z{};
+    // 15 window bits + 16 selects the gzip wrapper
+    if (deflateInit2(&z, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) return {};
+    std::string out(deflateBound(&z, data.size()), '\0');
+    z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    z.avail_in = static_cast<uInt>(data.size());
+    z.next_out = reinterpret_cast<Bytef*>(out.data());
+    z.avail_out = static_cast<uInt>(out.size());
+    int rc = deflate(&z, Z_FINISH);
+    out.resize(z.total_out);
+    deflateEnd(&z);
+    return rc == Z_STREAM_END ? out : std::string();
+}
+
+std::string brotliCompress(const std::string& data) {
+#ifdef BOOKTRACKER_HAVE_BROTLI
+    size_t size = BrotliEncoderMaxCompressedSize(data.size());
+    if (size == 0) return {};
+    std::string out(size, '\0');
+    if (!BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT,
+                               data.size(), reinterpret_cast<const uint8_t*>(data.data()),
+                               &size, reinterpret_cast<uint8_t*>(out.data()))) {
+        return {};
+    }
+    out.resize(size);
+    return out;
+#else
+    (void)data;
+    return {};
+#endif
+}
+
+// Variants only pay off when they save a useful share of the bytes.
+std::string keepIfSmaller(std::string compressed, const std::string& original) {
+    if (compressed.empty() || compressed.size() > original.size() * 9 / 10) return {};
+    return compressed;
+}
+
+// Fills in the version and compressed variants once identity is final.
+void finish(StaticAsset& asset) {
+    asset.version = contentHash(asset.identity);
+    if (compressible(asset.contentType)) {
+        asset.gzip = keepIfSmaller(gzipCompress(asset.identity), asset.identity);
+        asset.brotli = keepIfSmaller(brotliCompress(asset.identity), asset.identity);
+    }
+}
+
+bool readFile(const fs::path& path, std::string& out) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    std::ostringstream ss;
+    ss << in.rdbuf();
+    out = ss.str();
+    return !in.bad();
+}
+
+// Appends ?v=<version> to src="..." and href="..." values naming another
+// asset in the snapshot. Only attribute values quoted with " are touched.
+std::string versionReferences(const std::string& html, const std::string& page,
+                              const std::unordered_map<std::string, std::shared_ptr<const StaticAsset>>& assets) {
+    std::string dir = page.substr(0, page.rfind('/') + 1);
+    std::string out;
+    out.reserve(html.size() + 64);
+    size_t pos = 0;
+    while (pos < html.size()) {
+        size_t src = html.find("src=\"", pos);
+        size_t href = html.find("href=\"", pos);
+        size_t at = std::min(src, href);
+        if (at == std::string::npos) break;
+        size_t begin = html.find('"', at) + 1;
+        size_t end = html.find('"', begin);
+        if (end == std::string::npos) break;
+        std::string value = html.substr(begin, end - begin);
+        out.append(html, pos, end - pos);
+        pos = end;
+        if (value.empty() || value.find(':') != std::string::npos || value.find('?') != std::string::npos) continue;
+        auto it = assets.find(value[0] == '/' ? value : dir + value);
+        if (it != assets.end()) out += "?v=" + it->second->version;
+    }
+    out.append(html, pos, std::string::npos);
+    return out;
+}
+
+} // namespace
+
+const std::string& StaticAsset::body(Encoding encoding) const {
+    switch (encoding) {
+    case Encoding::Brotli: return brotli;
+    case Encoding::Gzip:   return gzip;
+    default:               return identity;
+    }
+}
+
+std::string StaticAsset::etag(Encoding encoding) const {
+    switch (encoding) {
+    case Encoding::Brotli: return "\"" + version + "-br\"";
+    case Encoding::Gzip:   return "\"" + version + "-gz\"";
+    default:               return "\"" + version + "\"";
+    }
+}
+
+StaticAssets::StaticAssets(std::string root) : root(std::move(root)) {
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    reload();
+    if (inotifyFd < 0 || stopFd < 0) {
+        std::cerr << "static assets: cannot watch " << this->root << "; changes need a restart\n";
+        return;
+    }
+    watcher = std::thread([this] { watch(); });
+}
+
+StaticAssets::~StaticAssets() {
+    if (watcher.joinable()) {
+        uint64_t one = 1;
+        if (write(stopFd, &one, sizeof one) < 0) std::cerr << "static assets: cannot stop watcher\n";
+        watcher.join();
+    }
+    if (inotifyFd >= 0) close(inotifyFd);
+    if (stopFd >= 0) close(stopFd);
+}
+
+std::shared_ptr<const StaticAsset> StaticAssets::find(const std::string& path) const {
+    std::shared_ptr<const Snapshot> current;
+    {
+        std::lock_guard<std::mutex> lock(snapshotMutex);
+        current = snapshot;
+    }
+    auto it = current->find(path);
+    if (it == current->end()) {
+        it = current->find(path.back() == '/' ? path + "index.html" : path + "/index.html");
+    }
+    return it == current->end() ? nullptr : it->second;
+}
+
+StaticAsset::Encoding StaticAssets::negotiate(const std::string& acceptEncoding, const StaticAsset& asset) {
+    // Among the acceptable codings, brotli beats gzip beats identity.
+    AcceptEncoding accepted(acceptEncoding);
+    if (accepted.accepts("br") && !asset.brotli.empty()) return StaticAsset::Encoding::Brotli;
+    if (accepted.accepts("gzip") && !asset.gzip.empty()) return StaticAsset::Encoding::Gzip;
+    return StaticAsset::Encoding::Identity;
+}
+
+void StaticAssets::reload() {
+    std::shared_ptr<const Snapshot> previous;
+    {
+        std::lock_guard<std::mutex> lock(snapshotMutex);
+        previous = snapshot;
+    }
+
+    auto next = std::make_shared<Snapshot>();
+    std::vector<std::pair<std::string, fs::path>> pages;
+    std::error_code ec;
+    auto watchDir = [this](const fs::path& dir) {
+        // Re-adding a watched directory just returns its existing watch.
+        if (inotifyFd >= 0) {
+            inotify_add_watch(inotifyFd, dir.c_str(),
+                              IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE);
+        }
+    };
+    watchDir(root);
+    for (auto it = fs::recursive_directory_iterator(root, ec); !ec && it != fs::recursive_directory_iterator();
+         it.increment(ec)) {
+        const fs::path& path = it->path();
+        if (path.filename().string().front() == '.') {
+            if (it->is_directory()) it.disable_recursion_pending();
+            continue;
+        }
+        if (it->is_directory()) {
+            watchDir(path);
+            continue;
+        }
+        struct stat st;
+        if (!it->is_regular_file() || stat(path.c_str(), &st) != 0) continue;
+
+        std::string key = "/" + fs::relative(path, root).generic_string();
+        if (path.extension() == ".html") {
+            pages.emplace_back(key, path);
+            continue;
+        }
+        if (previous) {
+            auto old = previous->find(key);
+            if (old != previous->end() && old->second->fileSize == static_cast<uintmax_t>(st.st_size) &&
+                old->second->modified == st.st_mtime) {
+                next->emplace(key, old->second);
+                continue;
+            }
+        }
+        auto asset = std::make_shared<StaticAsset>();
+        if (!readFile(path, asset->identity)) continue;
+        asset->contentType = contentTypeFor(path.extension().string());
+        asset->fileSize = st.st_size;
+        asset->modified = st.st_mtime;
+        finish(*asset);
+        next->emplace(key, std::move(asset));
+    }
+    if (ec) std::cerr << "static assets: cannot read " << root << ": " << ec.message() << "\n";
+
+    // Pages last: they embed the versions of everything else, so they are
+    // rebuilt on every reload.
+    for (auto& [key, path] : pages) {
+        auto asset = std::make_shared<StaticAsset>();
+        if (!readFile(path, asset->identity)) continue;
+        asset->identity = versionReferences(asset->identity, key, *next);
+        asset->contentType = contentTypeFor(".html");
+        finish(*asset);
+        next->emplace(key, std::move(asset));
+    }
+
+    std::lock_guard<std::mutex> lock(snapshotMutex);
+    snapshot = std::move(next);
+}
+
+void StaticAssets::watch() {
+    alignas(inotify_event) char buffer[4096];
+    pollfd fds[2] = {{inotifyFd, POLLIN, 0}, {stopFd, POLLIN, 0}};
+    while (true) {
+        if (poll(fds, 2, -1) < 0) continue;
+        if (fds[1].revents) return;
+        // Editors and deploys touch several files at once; let the burst
+        // settle, then reload once.
+        do {
+            while (read(inotifyFd, buffer, sizeof buffer) > 0) {}
+        } while (poll(fds, 1, 100) > 0);
+        try {
+            reload();
+        } catch (const std::exception& e) {
+            std::cerr << "static assets: reload failed: " << e.what() << "\n";
+        }
+    }
+}
@@ -0,0 +1,106 @@
+#include "tag_index.h"
+#include "sql.h"
+#include <algorithm>
+#include <cctype>
+
+std::vector<std::string> splitTags(const std::string& text) {
+    std::vector<std::string> tags;
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t comma = text.find(',', start);
+        if (comma == std::string::npos) comma = text.size();
+        size_t b = start, e = comma;
+        while (b < e && std::isspace(static_cast<unsigned char>(text[b]))) ++b;
+        while (e > b && std::isspace(static_cast<unsigned char>(text[e - 1]))) --e;
+        if (b < e) {
+            std::string tag = text.substr(b, e - b);
+            for (char& c : tag) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            if (std::find(tags.begin(), tags.end(), tag) == tags.end()) tags.push_back(std::move(tag));
+        }
+        start = comma + 1;
+    }
+    return tags;
+}
+
+TagWriter::TagWriter(Connection& conn) : conn(conn) {}
+
+void TagWriter::add(int userId, int64_t bookId, const std::string& text) {
+    for (const std::string& tag : splitTags(text)) {
+        int64_t tagId = intern(tag);
+        auto q = conn.prepare("INSERT INTO book_tags (book_id, tag_id, user_id) VALUES (?,?,?)");
+        sql::bind(*q, bookId, tagId, userId);
+        q->exec();
+    }
+}
+
+void TagWriter::replace(int userId, int64_t bookId, const std::string& text) {
+    {
+        auto q = conn.prepare("DELETE FROM book_tags WHERE book_id = ?");
+        sql::bind(*q, bookId);
+        q->exec();
+    }
+    add(userId, bookId, text);
+}
+
+int64_t TagWriter::intern(const std::string& name) {
+    auto it = ids.find(name);
+    if (it != ids.end()) return it->second;
+    // The no-op update makes RETURNING report existing names too.
+    auto q = conn.prepare(
+        "INSERT INTO tags (name) VALUES (?) "
+        "ON CONFLICT(name) DO UPDATE SET name = excluded.name RETURNING id");
+    sql::bind(*q, name);
+    q->executeStep();
+    int64_t id = q->getColumn(0).getInt64();
+    q->executeStep();
+    ids.emplace(name, id);
+    return id;
+}
+
+TagIndex::TagIndex(Loader loader) : loader(std::move(loader)) {}
+
+std::vector<uint32_t> TagIndex::books(int userId, const std::vector<int>& tagIds, bool matchAny) {
+    if (tagIds.empty()) return {};
+    std::shared_ptr<const UserTags> tags = load(userId);
+
+    IdBitmap result;
+    bool first = true;
+    for (int tagId : tagIds) {
+        auto it = tags->find(tagId);
+        if (it == tags->end()) {
+            // A tag on none of the user's books empties an AND query
+            if (!matchAny) return {};
+            continue;
+        }
+        if (first)         result = it->second;
+        else if (matchAny) result |= it->second;
+        else               result = result & it->second;
+        first = false;
+    }
+    return result.toVector();
+}
+
+void TagIndex::invalidate(int userId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    users.erase(userId);
+    ++generations[userId];
+}
+
+std::shared_ptr<const TagIndex::UserTags> TagIndex::load(int userId) {
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = users.find(userId);
+        if (it != users.end()) return it->second;
+        generation = generations[userId];
+    }
+
+    auto tags = std::make_shared<UserTags>();
+    loader(userId, [&](int tagId, int64_t bookId) {
+        (*tags)[tagId].add(static_cast<uint32_t>(bookId));
+    });
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (generations[userId] == generation) users.emplace(userId, tags);
+    return tags;
+}
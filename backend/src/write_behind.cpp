@@ -0,0 +1,182 @@
+#include "write_behind.h"
+#include <iostream>
+#include <stdexcept>
+
+WriteBehindQueue::WriteBehindQueue(Commit commit, std::chrono::milliseconds interval, size_t maxBatch)
+    : commit(std::move(commit)), interval(interval), maxBatch(maxBatch) {
+    committer = std::thread([this] { run(); });
+}
+
+WriteBehindQueue::~WriteBehindQueue() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    committer.join();
+    for (const auto& [key, update] : parked) {
+        std::cerr << "write-behind: update of book " << update.id << " of user " << update.userId
+                  << " was never saved\n";
+    }
+}
+
+uint64_t WriteBehindQueue::keyOf(const BookUpdate& update) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(update.userId)) << 32)
+         | static_cast<uint32_t>(update.id);
+}
+
+bool WriteBehindQueue::enqueue(uint64_t key, BookUpdate update) {
+    bool first = pending.empty();
+    if (first) firstPendingAt = std::chrono::steady_clock::now();
+    userSeq[update.userId] = ++pushedSeq;
+    pending.insert_or_assign(key, std::move(update));
+    // The committer needs waking to start a group and to cut the wait
+    // short once it is full; in between it is sleeping on a timer.
+    return first || pending.size() >= maxBatch;
+}
+
+std::vector<int> WriteBehindQueue::parkedBooks(int userId) const {
+    std::vector<int> books;
+    for (const auto& [key, update] : parked) {
+        if (update.userId == userId) books.push_back(update.id);
+    }
+    return books;
+}
+
+void WriteBehindQueue::push(BookUpdate update) {
+    uint64_t key = keyOf(update);
+    int userId = update.userId;
+    bool notify = false;
+    std::vector<int> lost;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // Replaces every field of a parked update to the same book
+        parked.erase(key);
+        for (auto it = parked.begin(); it != parked.end(); ) {
+            if (it->second.userId != userId) {
+                ++it;
+                continue;
+            }
+            lost.push_back(it->second.id);
+            notify |= enqueue(it->first, std::move(it->second));
+            it = parked.erase(it);
+        }
+        if (lost.empty()) notify |= enqueue(key, std::move(update));
+        else              unreported.erase(userId);
+    }
+    if (notify) wake.notify_one();
+    if (!lost.empty()) throw UpdateLost(std::move(lost));
+}
+
+void WriteBehindQueue::waitForUser(int userId) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto it = userSeq.find(userId);
+    uint64_t target = it == userSeq.end() ? 0 : it->second;
+    // Updates queued for another round are newer than committedSeq says
+    if (target > committedSeq || retrying.count(userId)) {
+        urgent = true;
+        wake.notify_one();
+        committed.wait(lock, [&] { return committedSeq >= target && retrying.count(userId) == 0; });
+    }
+    if (unreported.erase(userId)) {
+        std::vector<int> lost = parkedBooks(userId);
+        if (!lost.empty()) throw UpdateLost(std::move(lost));
+    }
+}
+
+void WriteBehindQueue::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        wake.wait(lock, [&] { return stopping || !pending.empty(); });
+        if (pending.empty()) return;    // stopping with nothing left
+
+        // Give the group until `interval` after its first update to fill.
+        wake.wait_until(lock, firstPendingAt + interval, [&] {
+            return stopping || urgent || pending.size() >= maxBatch;
+        });
+
+        std::vector<BookUpdate> group;
+        group.reserve(pending.size());
+        for (auto& [key, update] : pending) group.push_back(std::move(update));
+        pending.clear();
+        uint64_t seq = pushedSeq;
+        urgent = false;
+
+        // Users of updates back for another round; they stay "retrying"
+        // until this group is through.
+        std::vector<int> retried;
+        for (const BookUpdate& update : group) {
+            if (failedRounds.count(keyOf(update))) retried.push_back(update.userId);
+        }
+
+        lock.unlock();
+        std::vector<BookUpdate> failed = commitWithRetry(std::move(group));
+        lock.lock();
+
+        for (int userId : retried) {
+            if (--retrying[userId] == 0) retrying.erase(userId);
+        }
+
+        for (BookUpdate& update : failed) {
+            uint64_t key = keyOf(update);
+            // A newer update to the book replaces all of its fields anyway
+            if (pending.count(key)) {
+                failedRounds.erase(key);
+                continue;
+            }
+            if (++failedRounds[key] >= maxUpdateAttempts) {
+                std::cerr << "write-behind: parked update of book " << update.id << " of user "
+                          << update.userId << "\n";
+                failedRounds.erase(key);
+                unreported.insert(update.userId);
+                parked.insert_or_assign(key, std::move(update));
+                continue;
+            }
+            if (pending.empty()) firstPendingAt = std::chrono::steady_clock::now();
+            ++retrying[update.userId];
+            pending.emplace(key, std::move(update));
+        }
+        // Keys that went through are done with
+        if (!failedRounds.empty()) {
+            for (auto it = failedRounds.begin(); it != failedRounds.end(); ) {
+                if (pending.count(it->first)) ++it;
+                else it = failedRounds.erase(it);
+            }
+        }
+
+        committedSeq = seq;
+        for (auto it = userSeq.begin(); it != userSeq.end(); ) {
+            if (it->second <= seq) it = userSeq.erase(it);
+            else ++it;
+        }
+        committed.notify_all();
+    }
+}
+
+std::vector<BookUpdate> WriteBehindQueue::commitWithRetry(std::vector<BookUpdate> group) {
+    for (int attempt = 1; ; ++attempt) {
+        try {
+            commit(group);
+            return {};
+        } catch (const std::exception& e) {
+            std::cerr << "write-behind commit of " << group.size() << " update(s) failed (attempt "
+                      << attempt << "): " << e.what() << "\n";
+        }
+        if (attempt == groupAttempts) break;
+        std::this_thread::sleep_for(interval * (attempt * 2));
+    }
+    if (group.size() == 1) return group;
+
+    // One bad update should not sink the rest
+    std::vector<BookUpdate> failed;
+    for (BookUpdate& update : group) {
+        std::vector<BookUpdate> single{update};
+        try {
+            commit(single);
+        } catch (const std::exception& e) {
+            std::cerr << "write-behind commit of book " << update.id << " failed: " << e.what() << "\n";
+            failed.push_back(std::move(update));
+        }
+    }
+    return failed;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Shared pieces of the BookTrackerBench suite.
+namespace bench {
+
+using Clock = std::chrono::steady_clock;
+
+// Per-operation latencies for one benchmark, reported as throughput and
+// percentiles.
+class Latencies {
+public:
+    void add(Clock::duration d) {
+        samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+    }
+    void merge(const Latencies& other) {
+        samples.insert(samples.end(), other.samples.begin(), other.samples.end());
+    }
+    size_t count() const { return samples.size(); }
+
+    // Prints one row: name, ops, ops/s over `elapsed`, p50/p99/p99.9.
+    void report(const std::string& name, Clock::duration elapsed) {
+        std::sort(samples.begin(), samples.end());
+        double seconds = std::chrono::duration<double>(elapsed).count();
+        std::printf("%-44s %9zu ops %11.0f ops/s   p50 %9.1f us   p99 %9.1f us   p999 %9.1f us\n",
+                    name.c_str(), samples.size(), seconds > 0 ? samples.size() / seconds : 0.0,
+                    percentile(0.50), percentile(0.99), percentile(0.999));
+    }
+
+private:
+    // Nearest-rank percentile in microseconds; samples must be sorted.
+    double percentile(double p) const {
+        if (samples.empty()) return 0;
+        size_t rank = static_cast<size_t>(p * (samples.size() - 1) + 0.5);
+        return samples[rank] / 1000.0;
+    }
+
+    std::vector<int64_t> samples;
+};
+
+// Times `iterations` calls of fn(i) and reports them under name.
+template <typename Fn>
+void measure(const std::string& name, int iterations, Fn fn) {
+    Latencies latencies;
+    auto start = Clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        auto t = Clock::now();
+        fn(i);
+        latencies.add(Clock::now() - t);
+    }
+    latencies.report(name, Clock::now() - start);
+}
+
+// Fresh directory under $TMPDIR for a benchmark's database files; the
+// caller removes it.
+std::string makeTempDir();
+
+// Database microbenchmarks: listing, inserts, updates, session lookups and
+// user moves on a database in dir.
+void runDatabaseBenchmarks(const std::string& dir);
+
+// Concurrent writers on one shard versus spread over four.
+void runShardScalingBenchmark(const std::string& dir);
+
+// Book request parsing, JSON document versus BookInputParser, with heap
+// allocations per call; then parse + addBook on a database in dir.
+void runParseBenchmarks(const std::string& dir);
+
+struct LoadOptions {
+    int users = 16;
+    int seconds = 10;
+};
+
+// Serves the real routes from an in-process server and drives them from
+// one client thread per simulated user. Google Books is replaced by a
+// local stub so the run needs no network.
+void runLoadTest(const std::string& dir, const LoadOptions& options);
+
+} // namespace bench
@@ -0,0 +1,201 @@
+#include "bench.h"
+#include "database.h"
+#include <SQLiteCpp/SQLiteCpp.h>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace bench {
+
+std::string makeTempDir() {
+    const char* tmp = std::getenv("TMPDIR");
+    std::string pattern = std::string(tmp ? tmp : "/tmp") + "/booktracker-bench-XXXXXX";
+    if (!mkdtemp(pattern.data())) throw std::runtime_error("mkdtemp failed for " + pattern);
+    return pattern;
+}
+
+namespace {
+
+NewBook sampleBook(int i) {
+    static const char* statuses[] = {"Not Started", "Reading", "Completed"};
+    static const char* genres[] = {"Fiction", "History", "Science", "Fantasy", "Biography"};
+    NewBook b;
+    b.title = "Book " + std::to_string(i);
+    b.author = "Author " + std::to_string(i % 997);
+    b.genre = genres[i % 5];
+    b.status = statuses[i % 3];
+    b.totalPages = 100 + i % 400;
+    b.pagesRead = b.status == "Completed" ? b.totalPages : (b.status == "Reading" ? b.totalPages / 2 : 0);
+    b.notes = "Notes for book " + std::to_string(i);
+    b.tags = i % 2 ? "owned, favourite" : "library";
+    b.rating = i % 6;
+    return b;
+}
+
+BookInput viewOf(const NewBook& b) {
+    BookInput in;
+    in.title = b.title;
+    in.author = b.author;
+    in.genre = b.genre;
+    in.status = b.status;
+    in.pagesRead = b.pagesRead;
+    in.totalPages = b.totalPages;
+    in.notes = b.notes;
+    in.tags = b.tags;
+    in.goalEndDate = b.goalEndDate;
+    in.thumbnail = b.thumbnail;
+    in.rating = b.rating;
+    return in;
+}
+
+BookInput sampleUpdate(int i) {
+    BookInput in;
+    in.status = "Reading";
+    in.pagesRead = i % 300;
+    in.totalPages = 300;
+    in.notes = "updated";
+    in.tags = "owned";
+    in.rating = i % 6;
+    return in;
+}
+
+// Creates a user holding `books` sample books and returns their id.
+int seedUser(Database& db, const std::string& name, int books) {
+    db.createUser(name, "x");
+    int userId = db.getUserByUsername(name)->first;
+    std::vector<NewBook> batch;
+    for (int i = 0; i < books; ++i) {
+        batch.push_back(sampleBook(i));
+        if (batch.size() == 5000) {
+            db.importBooks(userId, batch);
+            batch.clear();
+        }
+    }
+    if (!batch.empty()) db.importBooks(userId, batch);
+    return userId;
+}
+
+std::vector<int> bookIds(const std::string& path, int userId) {
+    SQLite::Database raw(path, SQLite::OPEN_READONLY);
+    SQLite::Statement q(raw, "SELECT id FROM books WHERE user_id = ? ORDER BY id");
+    q.bind(1, userId);
+    std::vector<int> ids;
+    while (q.executeStep()) ids.push_back(q.getColumn(0).getInt());
+    return ids;
+}
+
+std::string isoIn(int days) {
+    std::time_t t = std::time(nullptr) + days * 24 * 3600;
+    std::ostringstream ss;
+    ss << std::put_time(std::gmtime(&t), "%Y-%m-%dT%H:%M:%SZ");
+    return ss.str();
+}
+
+} // namespace
+
+void runDatabaseBenchmarks(const std::string& dir) {
+    Database db(dir + "/data");
+    size_t bytes = 0;
+    JsonWriter::Sink discard = [&bytes](const char*, size_t size) {
+        bytes += size;
+        return true;
+    };
+
+    // Listing: whole library as one response, and the first page of 50
+    for (int rows : {10, 1000, 100000}) {
+        auto t = Clock::now();
+        int userId = seedUser(db, "list" + std::to_string(rows), rows);
+        std::printf("(seeded %d rows in %.2f s)\n", rows,
+                    std::chrono::duration<double>(Clock::now() - t).count());
+        int iterations = rows >= 100000 ? 20 : 2000;
+        BookQuery all;
+        measure("streamBooks all, " + std::to_string(rows) + " rows", iterations,
+                [&](int) { db.streamBooks(userId, all, discard); });
+        BookQuery page;
+        page.limit = 50;
+        page.sort = BookQuery::Sort::Title;
+        measure("streamBooks limit=50 by title, " + std::to_string(rows) + " rows", 2000,
+                [&](int) { db.streamBooks(userId, page, discard); });
+    }
+
+    int writer = seedUser(db, "writer", 1000);
+    measure("addBook", 5000, [&](int i) {
+        NewBook b = sampleBook(i);
+        db.addBook(writer, viewOf(b));
+    });
+
+    // updateBook only queues; dataVersion waits for the user's writes, so
+    // the second figure is the latency until an update is readable.
+    std::vector<int> ids = bookIds(Database::shardPath(dir + "/data", db.shardOf(writer)), writer);
+    std::mt19937 rng(42);
+    measure("updateBook (queued)", 20000, [&](int i) {
+        int id = ids[rng() % ids.size()];
+        db.updateBook(id, writer, sampleUpdate(i));
+    });
+    db.dataVersion(writer);
+    measure("updateBook + read-your-write", 2000, [&](int i) {
+        int id = ids[rng() % ids.size()];
+        db.updateBook(id, writer, sampleUpdate(i));
+        db.dataVersion(writer);
+    });
+
+    // Session lookups: answered by the session cache after the first hit
+    std::vector<std::string> tokens;
+    for (int i = 0; i < 1000; ++i) {
+        tokens.push_back("bench-token-" + std::to_string(i));
+        db.createSession(tokens.back(), writer, isoIn(7));
+    }
+    measure("getUserIdBySession", 200000, [&](int i) {
+        if (!db.getUserIdBySession(tokens[i % tokens.size()])) throw std::runtime_error("session lost");
+    });
+    measure("getUserIdBySession (unknown token)", 20000, [&](int i) {
+        db.getUserIdBySession("missing-" + std::to_string(i));
+    });
+    std::printf("(%zu bytes of JSON listed)\n", bytes);
+
+    // Rebalancing: a 1000-book user (with tags and sessions) to the next shard
+    int mover = seedUser(db, "mover", 1000);
+    measure("moveUser, 1000 books", 20, [&](int) {
+        db.moveUser(mover, (db.shardOf(mover) + 1) % db.shardCount());
+    });
+}
+
+void runShardScalingBenchmark(const std::string& dir) {
+    // Concurrent addBook from 8 users, each writing to their own shard's
+    // single writer; with one shard they all queue on the same one.
+    constexpr int threads = 8, perThread = 2000;
+    for (int shards : {1, 4}) {
+        Database::Options options;
+        options.shards = shards;
+        Database db(dir + "/scale" + std::to_string(shards), options);
+        std::vector<int> users;
+        for (int t = 0; t < threads; ++t) users.push_back(seedUser(db, "scale" + std::to_string(t), 0));
+
+        std::vector<Latencies> latencies(threads);
+        std::vector<std::thread> workers;
+        auto start = Clock::now();
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t] {
+                for (int i = 0; i < perThread; ++i) {
+                    NewBook b = sampleBook(i);
+                    auto opStart = Clock::now();
+                    db.addBook(users[t], viewOf(b));
+                    latencies[t].add(Clock::now() - opStart);
+                }
+            });
+        }
+        for (auto& w : workers) w.join();
+        auto elapsed = Clock::now() - start;
+        Latencies all;
+        for (const auto& l : latencies) all.merge(l);
+        all.report("addBook x" + std::to_string(threads) + " threads, " + std::to_string(shards) + " shard(s)",
+                   elapsed);
+    }
+}
+
+} // namespace bench
@@ -0,0 +1,203 @@
+#include "bench.h"
+#include "server.h"
+#include <nlohmann/json.hpp>
+#include <array>
+#include <atomic>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+namespace bench {
+
+namespace {
+
+// Canned Google Books answer; every query gets the same volumes.
+const char* stubVolumes = R"({"kind":"books#volumes","totalItems":2,"items":[
+{"id":"a1","volumeInfo":{"title":"The Left Hand of Darkness","authors":["Ursula K. Le Guin"],"pageCount":304}},
+{"id":"b2","volumeInfo":{"title":"A Wizard of Earthsea","authors":["Ursula K. Le Guin"],"pageCount":183}}]})";
+
+const char* searchTerms[] = {"le guin", "earthsea", "darkness", "dune", "foundation",
+                             "austen", "tolstoy", "borges", "calvino", "morrison"};
+
+enum Op { Login, List, Update, Session, Search, Cover, OpCount };
+const char* opNames[] = {"POST /api/login", "GET /api/books?limit=50", "PUT /api/books/:id",
+                         "POST session start+stop", "GET /api/search/:query", "GET /api/covers (+redirect)"};
+
+// Stand-in cover: a PNG signature, then id so each cover hashes apart,
+// padded to a typical thumbnail size.
+std::string stubCover(const std::string& id) {
+    std::string image = "\x89PNG\r\n\x1A\n" + id;
+    image.resize(16 * 1024, 'x');
+    return image;
+}
+
+// One client thread: signs up, seeds a few books, then loops over a mix of
+// requests until told to stop.
+struct User {
+    int index;
+    std::array<Latencies, OpCount> latencies;
+    int errors = 0;
+
+    void run(int port, const std::string& coverBase, const std::atomic<bool>& stop) {
+        httplib::Client client("127.0.0.1", port);
+        client.set_keep_alive(true);
+        std::mt19937 rng(index);
+        std::string name = "loaduser" + std::to_string(index);
+        std::string credentials = R"({"username":")" + name + R"(","password":"secret"})";
+        client.Post("/api/signup", credentials, "application/json");
+
+        httplib::Headers headers;
+        auto login = [&] {
+            auto res = client.Post("/api/login", credentials, "application/json");
+            if (!res || res->status != 200) return false;
+            // "session=<token>; HttpOnly; ..."
+            std::string cookie = res->get_header_value("Set-Cookie");
+            headers = {{"Cookie", cookie.substr(0, cookie.find(';'))}};
+            return true;
+        };
+        if (!login()) throw std::runtime_error("login failed for " + name);
+
+        std::vector<int> ids;
+        for (int i = 0; i < 20; ++i) {
+            std::string book = R"({"title":"Load book )" + std::to_string(i) +
+                               R"(","author":"Someone","genre":"Fiction","totalPages":300})";
+            client.Post("/api/books", headers, book, "application/json");
+        }
+        if (auto res = client.Get("/api/books", headers); res && res->status == 200) {
+            for (const auto& b : nlohmann::json::parse(res->body)) ids.push_back(b["id"].get<int>());
+        }
+        if (ids.empty()) throw std::runtime_error("no books listed for " + name);
+
+        while (!stop.load(std::memory_order_relaxed)) {
+            // 5% login, 45% list, 25% update, 15% session, 5% search, 5% cover
+            int roll = rng() % 100;
+            Op op = roll < 5 ? Login : roll < 50 ? List : roll < 75 ? Update : roll < 90 ? Session
+                  : roll < 95 ? Search : Cover;
+            int id = ids[rng() % ids.size()];
+            auto start = Clock::now();
+            bool ok = true;
+            switch (op) {
+            case Login:
+                ok = login();
+                break;
+            case List: {
+                auto res = client.Get("/api/books?limit=50", headers);
+                ok = res && res->status == 200;
+                break;
+            }
+            case Update: {
+                std::string body = R"({"status":"Reading","pagesRead":)" + std::to_string(rng() % 300) +
+                                   R"(,"totalPages":300,"notes":"load test","rating":4})";
+                auto res = client.Put("/api/books/" + std::to_string(id), headers, body, "application/json");
+                ok = res && res->status == 200;
+                break;
+            }
+            case Session: {
+                std::string path = "/api/books/" + std::to_string(id) + "/session/";
+                auto res = client.Post(path + "start", headers, R"({"startPagesRead":10})", "application/json");
+                ok = res && res->status == 201;
+                if (ok) {
+                    int sessionId = nlohmann::json::parse(res->body)["sessionId"].get<int>();
+                    res = client.Post(path + "stop", headers,
+                                      nlohmann::json{{"sessionId", sessionId}, {"endPagesRead", 30}}.dump(),
+                                      "application/json");
+                    ok = res && res->status == 200;
+                }
+                break;
+            }
+            case Search: {
+                auto res = client.Get(std::string("/api/search/") + searchTerms[rng() % 10], headers);
+                ok = res && res->status == 200;
+                break;
+            }
+            case Cover: {
+                std::string url = coverBase + "?id=" + std::to_string(rng() % 50);
+                auto res = client.Get("/api/covers?url=" + httplib::detail::encode_query_param(url), headers);
+                ok = res && res->status == 302;
+                if (ok) {
+                    res = client.Get(res->get_header_value("Location"), headers);
+                    ok = res && res->status == 200 && res->body.size() == 16 * 1024;
+                }
+                break;
+            }
+            default:
+                break;
+            }
+            latencies[op].add(Clock::now() - start);
+            if (!ok) ++errors;
+        }
+    }
+};
+
+} // namespace
+
+void runLoadTest(const std::string& dir, const LoadOptions& options) {
+    // Stand-in for the Google Books volumes endpoint
+    httplib::Server upstream;
+    upstream.Get("/books/v1/volumes", [](const httplib::Request&, httplib::Response& res) {
+        res.set_content(stubVolumes, "application/json");
+    });
+    // ... and for the image server behind volume thumbnails
+    upstream.Get("/books/content", [](const httplib::Request& req, httplib::Response& res) {
+        res.set_content(stubCover(req.get_param_value("id")), "image/png");
+    });
+    int upstreamPort = upstream.bind_to_any_port("127.0.0.1");
+    std::thread upstreamThread([&] { upstream.listen_after_bind(); });
+
+    Database db(dir + "/data");
+    GoogleBooksAPI::Options searchOptions;
+    searchOptions.baseUrl = "http://127.0.0.1:" + std::to_string(upstreamPort) + "/books/v1/volumes";
+    GoogleBooksAPI api(searchOptions);
+    RequestLog requestLog(dir + "/access.log");
+    httplib::Server svr;
+    Scheduler scheduler;
+    CoverStore::Options coverOptions;
+    coverOptions.root = dir + "/covers";
+    std::string coverBase = "http://127.0.0.1:" + std::to_string(upstreamPort) + "/books/content";
+    coverOptions.allowedPrefixes = {coverBase};
+    CoverStore covers(coverOptions, api);
+    registerRoutes(svr, db, api, requestLog, scheduler, covers);
+    int port = svr.bind_to_any_port("127.0.0.1");
+    std::thread serverThread([&] { svr.listen_after_bind(); });
+    svr.wait_until_ready();
+    upstream.wait_until_ready();
+
+    std::atomic<bool> stop{false};
+    std::vector<User> users(options.users);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < options.users; ++i) {
+        users[i].index = i;
+        threads.emplace_back([&, i] {
+            try {
+                users[i].run(port, coverBase, stop);
+            } catch (const std::exception& e) {
+                std::cerr << "user " << i << ": " << e.what() << "\n";
+            }
+        });
+    }
+    auto start = Clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(options.seconds));
+    stop = true;
+    for (auto& t : threads) t.join();
+    auto elapsed = Clock::now() - start;
+
+    svr.stop();
+    serverThread.join();
+    upstream.stop();
+    upstreamThread.join();
+
+    Latencies total;
+    int errors = 0;
+    for (int op = 0; op < OpCount; ++op) {
+        Latencies merged;
+        for (const User& u : users) merged.merge(u.latencies[op]);
+        total.merge(merged);
+        merged.report(opNames[op], elapsed);
+    }
+    for (const User& u : users) errors += u.errors;
+    total.report("all requests", elapsed);
+    std::printf("(%d failed requests)\n", errors);
+}
+
+} // namespace bench
@@ -0,0 +1,49 @@
+#include "bench.h"
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+// BookTrackerBench [db|parse|http|all] [--users N] [--seconds S]
+int main(int argc, char** argv) {
+    std::string suite = "all";
+    bench::LoadOptions load;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--users" && i + 1 < argc) {
+            load.users = std::atoi(argv[++i]);
+        } else if (arg == "--seconds" && i + 1 < argc) {
+            load.seconds = std::atoi(argv[++i]);
+        } else if (arg == "db" || arg == "parse" || arg == "http" || arg == "all") {
+            suite = arg;
+        } else {
+            std::cerr << "usage: " << argv[0] << " [db|parse|http|all] [--users N] [--seconds S]\n";
+            return 2;
+        }
+    }
+    if (load.users < 1 || load.seconds < 1) {
+        std::cerr << "--users and --seconds must be positive\n";
+        return 2;
+    }
+
+    if (suite == "db" || suite == "all") {
+        std::cout << "== Database ==\n";
+        std::string dir = bench::makeTempDir();
+        bench::runDatabaseBenchmarks(dir);
+        bench::runShardScalingBenchmark(dir);
+        std::filesystem::remove_all(dir);
+    }
+    if (suite == "parse" || suite == "all") {
+        std::cout << "== Request parsing ==\n";
+        std::string dir = bench::makeTempDir();
+        bench::runParseBenchmarks(dir);
+        std::filesystem::remove_all(dir);
+    }
+    if (suite == "http" || suite == "all") {
+        std::cout << "== HTTP load: " << load.users << " users, " << load.seconds << " s ==\n";
+        std::string dir = bench::makeTempDir();
+        bench::runLoadTest(dir, load);
+        std::filesystem::remove_all(dir);
+    }
+    return 0;
+}
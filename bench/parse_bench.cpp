@@ -0,0 +1,95 @@
+#include "bench.h"
+#include "book_input.h"
+#include "database.h"
+#include <nlohmann/json.hpp>
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+
+// Counts operator new calls per thread, so benchmarks can report heap
+// allocations per operation. SQLite allocates through malloc and is not
+// counted.
+static thread_local uint64_t allocations = 0;
+
+void* operator new(std::size_t size) {
+    ++allocations;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+namespace bench {
+
+namespace {
+
+// As sent by the frontend's add form
+const char* plainBody = R"({"title":"The Left Hand of Darkness","author":"Ursula K. Le Guin",)"
+                        R"("genre":"Science Fiction","status":"Not Started","pagesRead":0,)"
+                        R"("totalPages":304,"notes":"","tags":"owned, favourite","goalEndDate":"2025-12-31",)"
+                        R"("thumbnail":"http://books.google.com/books/content?id=a1&printsec=frontcover&img=1",)"
+                        R"("rating":3})";
+
+// Notes with a quote, a newline and non-ASCII escapes to decode
+const char* escapedBody = R"({"title":"Cien años de soledad","author":"Gabriel García Márquez",)"
+                          R"("genre":"Fiction","status":"Reading","pagesRead":120,"totalPages":417,)"
+                          R"("notes":"\"Muchos años después...\"\nReread chapter 1","tags":"library",)"
+                          R"("goalEndDate":"","thumbnail":"","rating":5})";
+
+volatile size_t keep;
+
+// What the handlers did before BookInput: a document, then a temporary
+// string per field.
+void parseWithDocument(const std::string& body) {
+    auto b = nlohmann::json::parse(body);
+    std::string title = b["title"], author = b["author"], genre = b["genre"];
+    std::string status = b.value("status", "Not Started");
+    int pagesRead = b.value("pagesRead", 0), totalPages = b.value("totalPages", 0);
+    std::string notes = b.value("notes", ""), tags = b.value("tags", "");
+    std::string goalEndDate = b.value("goalEndDate", ""), thumbnail = b.value("thumbnail", "");
+    int rating = b.value("rating", 3);
+    keep = title.size() + author.size() + genre.size() + status.size() + notes.size() + tags.size() +
+           goalEndDate.size() + thumbnail.size() + pagesRead + totalPages + rating;
+}
+
+void parseWithBookInput(const std::string& body) {
+    BookInputParser parser;
+    BookInput book;
+    if (!parser.parse(body, book) || checkBook(book, true)) throw std::runtime_error("rejected");
+    keep = book.title.size() + book.notes.size() + book.rating;
+}
+
+// measure(), then the heap allocations per call on this thread
+template <typename Fn>
+void measureAllocations(const std::string& name, int iterations, Fn fn) {
+    uint64_t before = allocations;
+    measure(name, iterations, fn);
+    std::printf("(%.1f heap allocations per op)\n", double(allocations - before) / iterations);
+}
+
+} // namespace
+
+void runParseBenchmarks(const std::string& dir) {
+    for (auto [label, body] : {std::pair{"plain", plainBody}, std::pair{"escaped", escapedBody}}) {
+        std::string text = body;
+        measureAllocations(std::string("book body, json document, ") + label, 200000,
+                           [&](int) { parseWithDocument(text); });
+        measureAllocations(std::string("book body, BookInputParser, ") + label, 200000,
+                           [&](int) { parseWithBookInput(text); });
+    }
+
+    // The whole POST /api/books path below HTTP: parse, then insert
+    Database db(dir + "/parse");
+    db.createUser("parser", "x");
+    int userId = db.getUserByUsername("parser")->first;
+    std::string text = plainBody;
+    measureAllocations("parse + addBook", 5000, [&](int) {
+        BookInputParser parser;
+        BookInput book;
+        parser.parse(text, book);
+        db.addBook(userId, book);
+    });
+}
+
+} // namespace bench
@@ -16,6 +16,13 @@ function computeProgress(book) {
     : 0;
 }
 
+// Google Books covers go through the server's cover cache; other URLs load directly
+function coverSrc(url) {
+    return /^https?:\/\/books\.google\.com\/books\/content/.test(url)
+    ? `/api/covers?url=${encodeURIComponent(url)}`
+    : url;
+}
+
 // Toggle dark mode
 function toggleDarkMode() {
     document.documentElement.classList.toggle('dark');
@@ -121,6 +128,11 @@ function initApp() {
     document.getElementById('addBookForm').addEventListener('submit', addBook);
     document.getElementById('filter').addEventListener('change', loadBooks);
     document.getElementById('sort').addEventListener('change', loadBooks);
+    let librarySearchTimer;
+    document.getElementById('librarySearch').addEventListener('input', () => {
+        clearTimeout(librarySearchTimer);
+        librarySearchTimer = setTimeout(loadBooks, 200);
+    });
     document.getElementById('progressSlider').addEventListener('input', () => {
         const tot = parseInt(document.getElementById('totalPages').value) || 0;
         const val = document.getElementById('progressSlider').value;
@@ -130,59 +142,47 @@ function initApp() {
 }
 
 // === Render Stats Dashboard ===
-function renderStats(books) {
+async function renderStats() {
+    // Aggregates are maintained server-side
+    const res = await fetch('/api/analytics', { credentials: 'include' });
+    if (!res.ok) return;
+    const a = await res.json();
     const s = document.getElementById('stats');
-    const total      = books.length;
-    const completed  = books.filter(b => b.status === 'Completed').length;
-    const reading    = books.filter(b => b.status === 'Reading').length;
-    const notStarted = books.filter(b => b.status === 'Not Started').length;
-    const ratings    = books.map(b => b.rating || 0).filter(r => r > 0);
-    const avgRating  = ratings.length
-    ? (ratings.reduce((a, b) => a + b, 0) / ratings.length).toFixed(1)
-    : '—';
-    const genreCounts = {};
-    books.forEach(b => {
-        if (b.genre) genreCounts[b.genre] = (genreCounts[b.genre] || 0) + 1;
-    });
-        const topGenre = Object.entries(genreCounts)
-        .sort((a, b) => b[1] - a[1])[0]?.[0] || '—';
+    const count = status => a.status_counts[status] || 0;
+    const avgRating = a.average_rating != null ? a.average_rating.toFixed(1) : '—';
 
         s.innerHTML = `
-        <div><strong>Total Books:</strong> ${total}</div>
-        <div><strong>Completed:</strong> ${completed}</div>
-        <div><strong>Reading:</strong> ${reading}</div>
-        <div><strong>Not Started:</strong> ${notStarted}</div>
+        <div><strong>Total Books:</strong> ${a.total_books}</div>
+        <div><strong>Completed:</strong> ${count('Completed')}</div>
+        <div><strong>Reading:</strong> ${count('Reading')}</div>
+        <div><strong>Not Started:</strong> ${count('Not Started')}</div>
         <div><strong>Avg. Rating:</strong> ${avgRating} ⭐️</div>
-        <div><strong>Top Genre:</strong> ${topGenre}</div>
+        <div><strong>Top Genre:</strong> ${a.top_genre || '—'}</div>
         `;
 }
 
 // === Load & Render Books ===
 async function loadBooks() {
-    const res = await fetch(apiBase, {
-        credentials: 'include'
-    });
-    let books = await res.json();
-    renderStats(books);
-
-    const f = document.getElementById('filter').value;
-    books = books.filter(b => {
-        if (f === 'reading')    return b.status === 'Reading';
-        if (f === 'completed')  return b.status === 'Completed';
-        if (f === 'not-started')return b.status === 'Not Started';
-        return true;
-    });
-
+    // Filtering and sorting happen server-side
+    const f  = document.getElementById('filter').value;
     const sv = document.getElementById('sort').value;
-    books.sort((a, b) => {
-        if (sv === 'title-asc')     return a.title.localeCompare(b.title);
-        if (sv === 'title-desc')    return b.title.localeCompare(a.title);
-        if (sv === 'progress-asc')  return computeProgress(a) - computeProgress(b);
-        if (sv === 'progress-desc') return computeProgress(b) - computeProgress(a);
-        if (sv === 'rating-asc')    return a.rating - b.rating;
-        if (sv === 'rating-desc')   return b.rating - a.rating;
-        return 0;
+    const statusNames = { 'reading': 'Reading', 'completed': 'Completed', 'not-started': 'Not Started' };
+    const [sort, dir] = sv.split('-');
+    const params = new URLSearchParams({ sort, dir });
+    if (statusNames[f]) params.set('status', statusNames[f]);
+
+    // A library search replaces the listing with ranked matches
+    const q = document.getElementById('librarySearch').value.trim();
+    const url = q
+    ? `${apiBase}/search?${new URLSearchParams({ q, limit: 100 })}`
+    : `${apiBase}?${params}`;
+
+    const res = await fetch(url, {
+        credentials: 'include'
     });
+    const books = q ? (await res.json()).books : await res.json();
+    // Stats describe the whole library whatever is listed
+    renderStats();
 
     const container = document.getElementById('books');
     container.innerHTML = '';
@@ -254,7 +254,7 @@ async function loadBooks() {
         div.className = "flex flex-col sm:flex-row gap-4 p-4 bg-white dark:bg-gray-800 rounded shadow";
         div.innerHTML = `
         <div class="flex-shrink-0">
-        ${book.thumbnail ? `<img src="${book.thumbnail}" alt="${book.title}" class="h-24 rounded"/>` : ''}
+        ${book.thumbnail ? `<img src="${coverSrc(book.thumbnail)}" alt="${book.title}" class="h-24 rounded"/>` : ''}
         </div>
         <div class="flex-1 flex flex-col gap-2">
         <div class="flex justify-between items-center">
@@ -394,17 +394,14 @@ async function stopSession(bookId) {
 
 // === Load sessions & render overview chart, pace & streak ===
 async function loadSessionsAndRenderOverview() {
-    const res = await fetch('/api/sessions', {
+    // Daily totals, pace and streak are rolled up server-side
+    const res = await fetch('/api/sessions/summary', {
         credentials: 'include'
     });
-    const sessions = await res.json();
-    const daily = {};
-    sessions.forEach(s => {
-        const d = s.startTime.split('T')[0];
-        daily[d] = (daily[d] || 0) + s.pagesRead;
-    });
-    const labels = Object.keys(daily).sort();
-    const data   = labels.map(d => daily[d]);
+    if (!res.ok) return;
+    const summary = await res.json();
+    const labels = summary.days.map(d => d.date);
+    const data   = summary.days.map(d => d.pages);
 
     const ctx = document.getElementById('overviewChart').getContext('2d');
     if (overviewChart) overviewChart.destroy();
@@ -414,18 +411,11 @@ async function loadSessionsAndRenderOverview() {
     });
 
     // Pace
-    const total = data.reduce((a,b) => a + b, 0);
-    const avg   = labels.length ? (total / labels.length).toFixed(1) : 0;
+    const avg = summary.average_pages_per_day.toFixed(1);
     document.getElementById('paceText').textContent = `Avg pages/day: ${avg}`;
 
     // Streak
-    let streak = 0;
-    for (let i = 0; ; i++) {
-        const d = new Date(); d.setDate(d.getDate() - i);
-        const ds = d.toISOString().split('T')[0];
-        if (daily[ds] > 0) streak++;
-        else break;
-    }
+    const streak = summary.streak;
     document.getElementById('streakText').textContent = `Reading streak: ${streak} day${streak === 1 ? '' : 's'}`;
 }
 
@@ -0,0 +1,175 @@
+// CoverStore against a local stand-in image server: fetching, single-flight,
+// rejection, LRU eviction and reloading the index after a restart.
+#include "cover_store.h"
+#include "httplib.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(cond)                                                                   \
+    do {                                                                              \
+        if (!(cond)) {                                                                \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK failed: " #cond "\n"; \
+            ++failures;                                                               \
+        }                                                                             \
+    } while (0)
+
+constexpr size_t coverBytes = 16 * 1024;
+
+// A PNG signature, then id so each cover hashes apart
+std::string pngCover(const std::string& id) {
+    std::string image = "\x89PNG\r\n\x1A\n" + id;
+    image.resize(coverBytes, 'x');
+    return image;
+}
+
+// Stand-in for the Google Books image server. Counts requests per id;
+// ?slow=1 holds the response back so concurrent resolves overlap.
+class ImageServer {
+public:
+    ImageServer() {
+        server.Get("/books/content", [this](const httplib::Request& req, httplib::Response& res) {
+            std::string id = req.get_param_value("id");
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ++hits[id];
+            }
+            if (req.get_param_value("slow") == "1") std::this_thread::sleep_for(std::chrono::milliseconds(300));
+            res.set_content(pngCover(id), "image/png");
+        });
+        server.Get("/books/page", [](const httplib::Request&, httplib::Response& res) {
+            res.set_content("<html>not an image</html>", "image/png");
+        });
+        port = server.bind_to_any_port("127.0.0.1");
+        thread = std::thread([this] { server.listen_after_bind(); });
+        server.wait_until_ready();
+    }
+    ~ImageServer() {
+        server.stop();
+        thread.join();
+    }
+
+    std::string url(const std::string& path) const {
+        return "http://127.0.0.1:" + std::to_string(port) + path;
+    }
+    int hitsFor(const std::string& id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return hits[id];
+    }
+
+private:
+    httplib::Server server;
+    int port = 0;
+    std::thread thread;
+    std::mutex mutex;
+    std::map<std::string, int> hits;
+};
+
+template <typename Exception, typename Fn>
+bool throws(Fn fn) {
+    try {
+        fn();
+    } catch (const Exception&) {
+        return true;
+    } catch (...) {
+    }
+    return false;
+}
+
+} // namespace
+
+int main() {
+    const char* tmp = std::getenv("TMPDIR");
+    std::string root = std::string(tmp ? tmp : "/tmp") + "/booktracker-covers-XXXXXX";
+    if (!mkdtemp(root.data())) {
+        std::cerr << "mkdtemp failed\n";
+        return 1;
+    }
+
+    ImageServer images;
+    GoogleBooksAPI api;
+    CoverStore::Options options;
+    options.root = root;
+    options.allowedPrefixes = {images.url("/books/")};
+    options.maxBytes = 3 * coverBytes;    // room for three covers
+    std::string a = images.url("/books/content?id=a");
+
+    {
+        CoverStore covers(options, api);
+
+        // Fetched once, then answered from the index
+        std::string hash = covers.resolve(a);
+        CHECK(CoverStore::isHash(hash));
+        CHECK(covers.resolve(a) == hash);
+        CHECK(images.hitsFor("a") == 1);
+        auto cover = covers.open(hash);
+        CHECK(cover && cover->size == coverBytes);
+        CHECK(cover && cover->contentType == "image/png");
+        CHECK(cover && std::string(cover->data, cover->size) == pngCover("a"));
+        CHECK(fs::exists(root + "/objects/" + hash.substr(0, 2) + "/" + hash));
+
+        // Concurrent resolves of a new URL share one fetch
+        std::string slow = images.url("/books/content?id=s&slow=1");
+        std::vector<std::string> results(8);
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < results.size(); ++i) {
+            threads.emplace_back([&, i] { results[i] = covers.resolve(slow); });
+        }
+        for (auto& t : threads) t.join();
+        CHECK(images.hitsFor("s") == 1);
+        for (const std::string& r : results) CHECK(r == results[0] && CoverStore::isHash(r));
+
+        // Rejected: bodies that are not images, and URLs off the allowed prefixes
+        CHECK(throws<std::invalid_argument>([&] { covers.resolve(images.url("/books/page")); }));
+        CHECK(throws<std::invalid_argument>([&] { covers.resolve(images.url("/elsewhere?id=x")); }));
+        CHECK(throws<std::invalid_argument>([&] { covers.resolve("http://example.com/books/content?id=x"); }));
+
+        // Three covers fit (a, s, b). Touching a makes s the least recently
+        // used, so storing c evicts it.
+        std::string b = covers.resolve(images.url("/books/content?id=b"));
+        CHECK(covers.open(hash) != nullptr);
+        std::string c = covers.resolve(images.url("/books/content?id=c"));
+        CHECK(covers.open(results[0]) == nullptr);
+        CHECK(!fs::exists(root + "/objects/" + results[0].substr(0, 2) + "/" + results[0]));
+        CHECK(covers.open(hash) != nullptr);
+        CHECK(covers.open(b) != nullptr);
+        CHECK(covers.open(c) != nullptr);
+        // An evicted URL is fetched again, evicting a in turn
+        CHECK(covers.resolve(slow) == results[0]);
+        CHECK(images.hitsFor("s") == 2);
+        CHECK(covers.open(hash) == nullptr);
+    }
+
+    {
+        // After a restart the URL index and stored covers are reused
+        CoverStore covers(options, api);
+        std::string hash = covers.resolve(images.url("/books/content?id=c"));
+        CHECK(images.hitsFor("c") == 1);
+        auto cover = covers.open(hash);
+        CHECK(cover && std::string(cover->data, cover->size) == pngCover("c"));
+        // ... and evicted covers stay gone
+        covers.resolve(a);
+        CHECK(images.hitsFor("a") == 2);
+    }
+
+    fs::remove_all(root);
+    if (failures) {
+        std::cerr << failures << " check(s) failed\n";
+        return 1;
+    }
+    std::cout << "cover store: all checks passed\n";
+    return 0;
+}
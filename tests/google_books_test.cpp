@@ -0,0 +1,171 @@
+// GoogleBooksAPI::search against a local stand-in for the volumes endpoint,
+// the way BOOKTRACKER_GOOGLE_BOOKS_URL points the server at one: cache
+// hits, single-flight coalescing, the maxWaiting overload limit and the
+// caller deadline.
+#include "api.h"
+#include "httplib.h"
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(cond)                                                                   \
+    do {                                                                              \
+        if (!(cond)) {                                                                \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK failed: " #cond "\n"; \
+            ++failures;                                                               \
+        }                                                                             \
+    } while (0)
+
+// Stand-in for the volumes endpoint. Answers {"q":"<query>"} and counts
+// requests per query; queries starting "held" wait until release().
+class VolumesServer {
+public:
+    VolumesServer() {
+        server.Get("/volumes", [this](const httplib::Request& req, httplib::Response& res) {
+            std::string q = req.get_param_value("q");
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ++hits[q];
+                if (q.rfind("held", 0) == 0) {
+                    ++held;
+                    changed.notify_all();
+                    changed.wait_for(lock, std::chrono::seconds(10), [this] { return released; });
+                }
+            }
+            res.set_content("{\"q\":\"" + q + "\"}", "application/json");
+        });
+        port = server.bind_to_any_port("127.0.0.1");
+        thread = std::thread([this] { server.listen_after_bind(); });
+        server.wait_until_ready();
+    }
+    ~VolumesServer() {
+        release();
+        server.stop();
+        thread.join();
+    }
+
+    std::string url() const { return "http://127.0.0.1:" + std::to_string(port) + "/volumes"; }
+    int hitsFor(const std::string& q) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return hits[q];
+    }
+    // Waits until n held requests have arrived.
+    bool waitHeld(int n) {
+        std::unique_lock<std::mutex> lock(mutex);
+        return changed.wait_for(lock, std::chrono::seconds(5), [&] { return held >= n; });
+    }
+    void release() {
+        std::lock_guard<std::mutex> lock(mutex);
+        released = true;
+        changed.notify_all();
+    }
+
+private:
+    httplib::Server server;
+    int port = 0;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::map<std::string, int> hits;
+    int held = 0;
+    bool released = false;
+};
+
+template <typename Exception, typename Fn>
+bool throws(Fn fn) {
+    try {
+        fn();
+    } catch (const Exception&) {
+        return true;
+    } catch (...) {
+    }
+    return false;
+}
+
+} // namespace
+
+int main() {
+    VolumesServer volumes;
+    GoogleBooksAPI::Options options;
+    options.baseUrl = volumes.url();
+    options.maxWaiting = 4;
+    GoogleBooksAPI api(options);
+
+    // Fetched once, then answered from the cache; queries differing only in
+    // case and spacing share an entry
+    auto body = api.search("Dune");
+    CHECK(body && *body == R"({"q":"dune"})");
+    CHECK(api.search("  DUNE ") == body);
+    CHECK(volumes.hitsFor("dune") == 1);
+
+    // Concurrent searches for the same query share one upstream request
+    std::vector<SearchCache::Body> results(4);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < results.size(); ++i) {
+        threads.emplace_back([&, i] { results[i] = api.search("heldshared"); });
+    }
+    CHECK(volumes.waitHeld(1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));    // let the rest join the flight
+    volumes.release();
+    for (auto& t : threads) t.join();
+    CHECK(volumes.hitsFor("heldshared") == 1);
+    for (const auto& r : results) CHECK(r && r == results[0]);
+
+    {
+        // Past maxWaiting callers on upstream, the next is turned away at
+        // once; a cached query is still answered
+        VolumesServer slow;
+        GoogleBooksAPI::Options limited;
+        limited.baseUrl = slow.url();
+        limited.maxWaiting = 2;
+        GoogleBooksAPI busy(limited);
+        CHECK(busy.search("cached") != nullptr);
+
+        std::vector<std::thread> waiters;
+        for (const char* q : {"heldone", "heldtwo"}) {
+            waiters.emplace_back([&busy, q] { busy.search(q); });
+        }
+        CHECK(slow.waitHeld(2));
+        auto start = std::chrono::steady_clock::now();
+        CHECK(throws<SearchOverloaded>([&] { busy.search("another"); }));
+        CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(500));
+        CHECK(slow.hitsFor("another") == 0);
+        CHECK(busy.search("cached") != nullptr);
+        slow.release();
+        for (auto& t : waiters) t.join();
+        // Room again once the waiters are answered
+        CHECK(busy.search("another") != nullptr);
+    }
+
+    {
+        // A caller past its deadline gets SearchTimeout, and the late answer
+        // is cached for the next one
+        VolumesServer late;
+        GoogleBooksAPI::Options hasty;
+        hasty.baseUrl = late.url();
+        hasty.deadline = std::chrono::milliseconds(200);
+        GoogleBooksAPI api2(hasty);
+        CHECK(throws<SearchTimeout>([&] { api2.search("heldlate"); }));
+        late.release();
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        auto answer = api2.search("heldlate");
+        CHECK(answer && *answer == R"({"q":"heldlate"})");
+        CHECK(late.hitsFor("heldlate") == 1);
+    }
+
+    if (failures) {
+        std::cerr << failures << " check(s) failed\n";
+        return 1;
+    }
+    std::cout << "google books search: all checks passed\n";
+    return 0;
+}